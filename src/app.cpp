@@ -1,12 +1,15 @@
 
 #include <SDL2/SDL.h>
+#include <fstream>
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_sdl.h>
 
 #include "app.h"
 #include "geometry/util.h"
 #include "platform/platform.h"
+#include "gui/render_bench.h"
 #include "scene/renderer.h"
+#include "util/benchmark.h"
 
 App::App(Settings set, Platform* plt)
     : window_dim(plt ? plt->window_draw() : Vec2{1.0f}),
@@ -41,12 +44,58 @@ App::App(Settings set, Platform* plt)
         GL::global_params();
         Renderer::setup(window_dim);
         apply_window_dim(plt->window_draw());
+    } else if(set.parallel_benchmark) {
+
+        info("Benchmarking parallel loops...");
+        err = Benchmark::parallel();
+        if(!err.empty()) warn("Error benchmarking: %s", err.c_str());
+
+    } else if(set.render_benchmark) {
+
+        info("Benchmarking renders...");
+        Gui::Render_Bench bench;
+        if(!set.bench_scenes.empty()) bench.scene_files = set.bench_scenes;
+        bench.scene_files.insert(bench.scene_files.end(), set.bench_add_scenes.begin(),
+                                 set.bench_add_scenes.end());
+        bench.references = set.bench_references;
+        bench.report_file = set.stats_file;
+        bench.w = set.w;
+        bench.h = set.h;
+        bench.s = set.s;
+        bench.ls = set.ls;
+        bench.d = set.d;
+        bench.seed = set.seed ? set.seed : 1;
+        gui.get_render().tracer().set_mis(set.mis);
+        gui.get_render().tracer().set_roulette(set.roulette,
+                                               (size_t)std::max(set.roulette_depth, 0));
+        err = Gui::render_bench(gui, undo, scene, bench);
+        if(!err.empty()) warn("Error benchmarking renders: %s", err.c_str());
+
+    } else if(loaded_scene && set.roulette_benchmark) {
+
+        info("Benchmarking roulette policies...");
+        gui.get_render().tracer().set_mis(set.mis);
+        gui.get_render().tracer().set_guiding(set.guiding);
+        gui.get_render().tracer().set_denoise(set.denoise);
+        for(PT::AOV aov : set.aovs) gui.get_render().tracer().set_aov(aov, true);
+        err = gui.get_render().benchmark_roulette(scene, set.w, set.h, set.s, set.ls, set.d,
+                                                  set.w_from_ar, std::max(set.roulette_depth, 0));
+        if(!err.empty()) warn("Error benchmarking scene: %s", err.c_str());
+
     } else if(loaded_scene) {
 
         info("Rendering scene...");
+        gui.get_render().tracer().set_roulette(set.roulette,
+                                               (size_t)std::max(set.roulette_depth, 0));
+        gui.get_render().tracer().set_seed(set.seed);
+        gui.get_render().tracer().set_mis(set.mis);
+        gui.get_render().tracer().set_guiding(set.guiding);
+        gui.get_render().tracer().set_denoise(set.denoise);
+        for(PT::AOV aov : set.aovs) gui.get_render().tracer().set_aov(aov, true);
         err = gui.get_render().headless_render(gui.get_animate(), scene, set.output_file,
                                                set.animate, set.w, set.h, set.s, set.ls, set.d,
-                                               set.exp, set.w_from_ar);
+                                               set.exp, set.w_from_ar, set.time_budget,
+                                               set.pipeline_depth, set.pipeline_memory);
 
         if(!err.empty())
             warn("Error rendering scene: %s", err.c_str());
@@ -54,6 +103,12 @@ App::App(Settings set, Platform* plt)
             auto [build, render] = gui.get_render().completion_time();
             info("Built scene in %.2fs, rendered in %.2fs", build, render);
         }
+
+        if(err.empty() && !set.stats_file.empty()) {
+            std::ofstream out(set.stats_file);
+            out << gui.get_render().stats().to_json();
+            if(!out) warn("Error writing statistics to %s", set.stats_file.c_str());
+        }
     }
 }
 
@@ -32,6 +32,24 @@ public:
         bool animate = false;
         float exp = 1.0f;
         bool w_from_ar = false;
+        float time_budget = 0.0f;
+        PT::Roulette_Policy roulette = PT::Roulette_Policy::throughput;
+        int roulette_depth = 2;
+        bool roulette_benchmark = false;
+        bool parallel_benchmark = false;
+        bool render_benchmark = false;
+        std::vector<std::string> bench_scenes, bench_add_scenes;
+        std::string bench_references = "references";
+        unsigned int seed = 0;
+        bool pin_threads = false;
+        PT::MIS_Mode mis = PT::MIS_Mode::none;
+        bool guiding = false;
+        bool denoise = false;
+        std::vector<PT::AOV> aovs;
+        int pipeline_depth = 1;
+        int pipeline_memory = 1024;
+        std::string stats_file;
+        std::string profile_file;
     };
 
     App(Settings set, Platform* plt = nullptr);
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+#include "bench.h"
+
+namespace Bench {
+
+// Batches timed per benchmark; the median is reported
+static const int batches = 7;
+
+using Clock = std::chrono::steady_clock;
+
+static double seconds(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+Suite::Suite(std::string filter, double min_time)
+    : filter(std::move(filter)), min_time(std::max(min_time, 1e-4)) {
+}
+
+bool Suite::skip(const std::string& name) const {
+    return !filter.empty() && name.find(filter) == std::string::npos;
+}
+
+void Suite::run(const std::string& name, std::function<void(size_t)> f) {
+
+    if(skip(name)) return;
+
+    // Grow the batch until it takes long enough to time
+    size_t n = 1;
+    for(;;) {
+        auto start = Clock::now();
+        f(n);
+        double took = seconds(Clock::now() - start);
+        if(took >= min_time || n >= (size_t(1) << 40)) break;
+        n = took <= 0.0 ? n * 16 : std::max(n * 2, (size_t)(n * 1.2 * min_time / took));
+    }
+
+    std::vector<double> times;
+    for(int i = 0; i < batches; i++) {
+        auto start = Clock::now();
+        f(n);
+        times.push_back(seconds(Clock::now() - start));
+    }
+    add(name, n, std::move(times));
+}
+
+void Suite::run(const std::string& name, std::function<void()> setup, std::function<void()> op) {
+
+    if(skip(name)) return;
+
+    auto batch = [&](size_t n) {
+        double total = 0.0;
+        for(size_t i = 0; i < n; i++) {
+            setup();
+            auto start = Clock::now();
+            op();
+            total += seconds(Clock::now() - start);
+        }
+        return total;
+    };
+
+    size_t n = 1;
+    while(batch(n) < min_time && n < (size_t(1) << 20)) n *= 2;
+
+    std::vector<double> times;
+    for(int i = 0; i < batches; i++) times.push_back(batch(n));
+    add(name, n, std::move(times));
+}
+
+void Suite::add(const std::string& name, size_t n, std::vector<double> times) {
+
+    std::sort(times.begin(), times.end());
+    Result r;
+    r.name = name;
+    r.iterations = n;
+    r.ns = times[times.size() / 2] * 1e9 / n;
+    r.min_ns = times[0] * 1e9 / n;
+    results.push_back(r);
+
+    printf("%-48s %14.2f ns %14.2f ns (min) %12zu\n", name.c_str(), r.ns, r.min_ns, n);
+    fflush(stdout);
+}
+
+std::string Suite::json() const {
+
+    std::stringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"batches\": " << batches << ",\n  \"benchmarks\": [";
+    for(size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name
+            << "\", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.ns
+            << ", \"min_ns_per_op\": " << r.min_ns << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+} // namespace Bench
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A small harness for timing the core kernels. Each benchmark is timed in
+// batches large enough to measure reliably, and the median batch is reported.
+namespace Bench {
+
+// Keeps the compiler from optimizing away value or the work that produced it
+template<typename T> inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const volatile void* sink;
+    sink = &value;
+#endif
+}
+
+struct Result {
+    std::string name;
+    size_t iterations = 0;         // per batch
+    double ns = 0.0, min_ns = 0.0; // per operation: median and fastest batch
+};
+
+class Suite {
+public:
+    /// Benchmarks whose name does not contain filter are skipped
+    Suite(std::string filter, double min_time);
+
+    /// f(n) performs n operations
+    void run(const std::string& name, std::function<void(size_t)> f);
+    /// setup() prepares each operation and is not timed
+    void run(const std::string& name, std::function<void()> setup, std::function<void()> op);
+
+    std::string json() const;
+
+private:
+    bool skip(const std::string& name) const;
+    void add(const std::string& name, size_t n, std::vector<double> batches);
+
+    std::string filter;
+    double min_time;
+    std::vector<Result> results;
+};
+
+} // namespace Bench
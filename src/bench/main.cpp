@@ -0,0 +1,284 @@
+#include <fstream>
+#include <sf_libs/CLI11.hpp>
+
+#include "../geometry/halfedge.h"
+#include "../geometry/util.h"
+#include "../rays/samplers.h"
+#include "../rays/shapes.h"
+#include "../rays/tri_mesh.h"
+#include "../util/camera.h"
+#include "../util/hdr_image.h"
+#include "../util/rand.h"
+
+#include "bench.h"
+
+// Microbenchmarks for the kernels the path tracer and mesh editor spend their
+// time in. Everything runs without a window or GL context.
+
+static const size_t n_inputs = 1024;
+
+static std::vector<Vec3> random_vecs(float scale = 1.0f) {
+    std::vector<Vec3> ret(n_inputs);
+    for(Vec3& v : ret) {
+        v = scale * Vec3(RNG::unit() * 2.0f - 1.0f, RNG::unit() * 2.0f - 1.0f,
+                         RNG::unit() * 2.0f - 1.0f);
+    }
+    return ret;
+}
+
+static std::vector<Mat4> random_mats() {
+    std::vector<Mat4> ret(n_inputs);
+    std::vector<Vec3> t = random_vecs(10.0f), r = random_vecs(180.0f), s = random_vecs();
+    for(size_t i = 0; i < n_inputs; i++) {
+        ret[i] = Mat4::translate(t[i]) * Mat4::euler(r[i]) * Mat4::scale(s[i] + Vec3(1.5f));
+    }
+    return ret;
+}
+
+// Rays from a sphere of radius 3 towards random points inside the unit cube
+static std::vector<Ray> random_rays() {
+    std::vector<Ray> ret;
+    std::vector<Vec3> from = random_vecs(), to = random_vecs();
+    for(size_t i = 0; i < n_inputs; i++) {
+        Vec3 o = from[i].unit() * 3.0f;
+        ret.push_back(Ray(o, to[i] - o));
+    }
+    return ret;
+}
+
+static void bench_math(Bench::Suite& suite) {
+
+    std::vector<Vec3> a = random_vecs(), b = random_vecs();
+    std::vector<Mat4> m = random_mats(), m2 = random_mats();
+
+    suite.run("Vec3 dot", [&](size_t n) {
+        float sum = 0.0f;
+        for(size_t i = 0; i < n; i++) sum += dot(a[i % n_inputs], b[i % n_inputs]);
+        Bench::keep(sum);
+    });
+    suite.run("Vec3 cross", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(cross(a[i % n_inputs], b[i % n_inputs]));
+    });
+    suite.run("Vec3 unit", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(a[i % n_inputs].unit());
+    });
+    suite.run("Mat4 * Mat4", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(m[i % n_inputs] * m2[i % n_inputs]);
+    });
+    suite.run("Mat4 * Vec3", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(m[i % n_inputs] * a[i % n_inputs]);
+    });
+    suite.run("Mat4::rotate", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(m[i % n_inputs].rotate(a[i % n_inputs]));
+    });
+    suite.run("Mat4::inverse", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(Mat4::inverse(m[i % n_inputs]));
+    });
+    suite.run("Mat4::rotate_to", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(Mat4::rotate_to(a[i % n_inputs].unit()));
+    });
+    suite.run("Frame::from_y", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(Frame::from_y(a[i % n_inputs].unit()));
+    });
+}
+
+static void bench_intersect(Bench::Suite& suite) {
+
+    std::vector<Ray> rays = random_rays();
+    std::vector<Ray_Box> box_rays;
+    for(const Ray& r : rays) box_rays.push_back(Ray_Box(r));
+    BBox box(Vec3(-0.5f), Vec3(0.5f));
+
+    suite.run("BBox::hit", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            Vec2 times;
+            Bench::keep(box.hit(rays[i % n_inputs], times));
+        }
+    });
+    suite.run("BBox::hit (Ray_Box)", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            Vec2 times = rays[i % n_inputs].dist_bounds;
+            Bench::keep(box.hit(box_rays[i % n_inputs], times));
+        }
+    });
+
+    // Triangles can only be made by a Tri_Mesh, so this includes its one-node BVH
+    PT::Tri_Mesh triangle(Util::quad_mesh(1.0f, 1.0f));
+    suite.run("Triangle::hit (quad mesh)", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            Ray r = rays[i % n_inputs];
+            Bench::keep(triangle.hit(r));
+        }
+    });
+
+    PT::Sphere sphere(1.0f);
+    suite.run("Sphere::hit", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            Ray r = rays[i % n_inputs];
+            Bench::keep(sphere.hit(r));
+        }
+    });
+}
+
+static void bench_samplers(Bench::Suite& suite) {
+
+    HDR_Image env(256, 128);
+    for(size_t j = 0; j < 128; j++) {
+        for(size_t i = 0; i < 256; i++) env.at(i, j) = Spectrum(RNG::unit() * (j > 100 ? 50.0f : 1.0f));
+    }
+    std::vector<Vec3> dirs = random_vecs();
+    for(Vec3& d : dirs) d = d.unit();
+
+    suite.run("RNG::unit", [&](size_t n) {
+        float sum = 0.0f;
+        for(size_t i = 0; i < n; i++) sum += RNG::unit();
+        Bench::keep(sum);
+    });
+
+    Samplers::Point point(Vec3(1.0f));
+    Samplers::Two_Points two(Vec3(1.0f), Vec3(-1.0f), 0.3f);
+    Samplers::Rect::Uniform rect(Vec2(2.0f, 1.0f));
+    Samplers::Hemisphere::Uniform hemi;
+    Samplers::Hemisphere::Cosine cosine;
+    Samplers::Sphere::Uniform sphere;
+    Samplers::Sphere::Image image(env);
+
+    auto sample = [&](const std::string& name, const auto& sampler) {
+        suite.run("Samplers::" + name + "::sample", [&](size_t n) {
+            float pdf;
+            for(size_t i = 0; i < n; i++) Bench::keep(sampler.sample(pdf));
+        });
+    };
+    auto pdf = [&](const std::string& name, const auto& sampler) {
+        suite.run("Samplers::" + name + "::pdf", [&](size_t n) {
+            for(size_t i = 0; i < n; i++) Bench::keep(sampler.pdf(dirs[i % n_inputs]));
+        });
+    };
+    sample("Point", point);
+    sample("Two_Points", two);
+    sample("Rect::Uniform", rect);
+    sample("Hemisphere::Uniform", hemi);
+    pdf("Hemisphere::Uniform", hemi);
+    sample("Hemisphere::Cosine", cosine);
+    pdf("Hemisphere::Cosine", cosine);
+    sample("Sphere::Uniform", sphere);
+    pdf("Sphere::Uniform", sphere);
+    sample("Sphere::Image", image);
+
+    Camera camera(Vec2(16.0f, 9.0f));
+    std::vector<Vec2> coords(n_inputs);
+    for(Vec2& c : coords) c = Vec2(RNG::unit(), RNG::unit());
+    Camera_Rays rays;
+
+    suite.run("Camera::generate_ray", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) Bench::keep(camera.generate_ray(coords[i % n_inputs]));
+    });
+    suite.run("Camera::generate_rays", [&](size_t n) {
+        for(size_t i = 0; i < n; i += n_inputs) {
+            camera.generate_rays(coords.data(), std::min(n_inputs, n - i), rays);
+            Bench::keep(rays.dx[0]);
+        }
+    });
+}
+
+static void bench_bvh(Bench::Suite& suite) {
+
+    struct Synthetic {
+        std::string name;
+        GL::Mesh mesh;
+    };
+    Synthetic meshes[] = {{"sphere", Util::sphere_mesh(1.0f, 5)},
+                          {"torus", Util::torus_mesh(0.3f, 1.0f, 256, 128)}};
+
+    std::vector<Ray> rays = random_rays();
+    for(Synthetic& s : meshes) {
+        std::string tris = std::to_string(s.mesh.tris());
+
+        suite.run("BVH build (" + s.name + ", " + tris + " triangles)", [&](size_t n) {
+            for(size_t i = 0; i < n; i++) Bench::keep(PT::Tri_Mesh(s.mesh).bbox());
+        });
+
+        PT::Tri_Mesh mesh(s.mesh);
+        suite.run("BVH hit (" + s.name + ", " + tris + " triangles)", [&](size_t n) {
+            for(size_t i = 0; i < n; i++) {
+                Ray r = rays[i % n_inputs];
+                Bench::keep(mesh.hit(r));
+            }
+        });
+    }
+}
+
+static void bench_image(Bench::Suite& suite) {
+
+    HDR_Image image(1280, 720);
+    for(size_t i = 0; i < 1280 * 720; i++) {
+        image.at(i) = Spectrum(RNG::unit(), RNG::unit(), RNG::unit()) * 4.0f;
+    }
+    std::vector<unsigned char> data;
+    suite.run("HDR_Image::tonemap_to (1280x720)", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            image.at(i % (1280 * 720)) += Spectrum(0.001f);
+            image.tonemap_to(data, 1.0f);
+            Bench::keep(data[0]);
+        }
+    });
+}
+
+static void bench_halfedge(Bench::Suite& suite) {
+
+    GL::Mesh cube = Util::cube_mesh(1.0f);
+    GL::Mesh sphere = Util::sphere_mesh(1.0f, 3);
+
+    suite.run("Halfedge_Mesh build (sphere)", [&](size_t n) {
+        for(size_t i = 0; i < n; i++) {
+            Halfedge_Mesh mesh(sphere);
+            Bench::keep(mesh.n_vertices());
+        }
+    });
+
+    Halfedge_Mesh mesh;
+    auto subdivide = [&](const std::string& name, SubD strategy, const GL::Mesh& base) {
+        suite.run(
+            "Halfedge_Mesh::subdivide (" + name + ")", [&]() { mesh.from_mesh(base); },
+            [&]() { Bench::keep(mesh.subdivide(strategy)); });
+    };
+    subdivide("linear, cube", SubD::linear, cube);
+    subdivide("catmull-clark, cube", SubD::catmullclark, cube);
+    subdivide("loop, sphere", SubD::loop, sphere);
+
+    suite.run(
+        "Halfedge_Mesh::simplify (sphere)", [&]() { mesh.from_mesh(sphere); },
+        [&]() { Bench::keep(mesh.simplify()); });
+}
+
+int main(int argc, char** argv) {
+
+    RNG::seed();
+
+    std::string filter, json;
+    double min_time = 0.05;
+
+    CLI::App args{"Cardinal3D - kernel benchmarks"};
+    args.add_option("-f,--filter", filter, "Only run benchmarks whose name contains this");
+    args.add_option("--min_time", min_time, "Seconds each timed batch should take at least");
+    args.add_option("--json", json, "Write the results to this JSON file");
+    CLI11_PARSE(args, argc, argv);
+
+    Bench::Suite suite(filter, min_time);
+    bench_math(suite);
+    bench_intersect(suite);
+    bench_samplers(suite);
+    bench_bvh(suite);
+    bench_image(suite);
+    bench_halfedge(suite);
+
+    if(!json.empty()) {
+        std::ofstream out(json);
+        out << suite.json();
+        if(!out) {
+            fprintf(stderr, "Failed to write %s\n", json.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <unordered_map>
 #include <iostream>
 #include "../gui/widgets.h"
+#include "../util/profiler.h"
 
 Halfedge_Mesh::Halfedge_Mesh() {
     next_id = Gui::n_Widget_IDs;
@@ -262,6 +263,7 @@ Vec3 Halfedge_Mesh::center_of(Halfedge_Mesh::ElementRef elem) {
 
 void Halfedge_Mesh::to_mesh(GL::Mesh& mesh, bool split_faces) const {
 
+    Profiler::Zone zone("Halfedge_Mesh::to_mesh");
     std::vector<GL::Mesh::Vert> verts;
     std::vector<GL::Mesh::Index> idxs;
 
@@ -369,6 +371,8 @@ std::optional<std::pair<Halfedge_Mesh::ElementRef, std::string>> Halfedge_Mesh::
 
 std::optional<std::pair<Halfedge_Mesh::ElementRef, std::string>> Halfedge_Mesh::validate() {
 
+    Profiler::Zone zone("Halfedge_Mesh::validate");
+
     for(VertexRef v = vertices_begin(); v != vertices_end(); v++) {
         Vec3 p = v->pos;
         bool finite = std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z);
@@ -509,6 +513,7 @@ void Halfedge_Mesh::do_erase() {
 
 std::string Halfedge_Mesh::from_mesh(const GL::Mesh& mesh) {
 
+    Profiler::Zone zone("Halfedge_Mesh::from_mesh");
     auto idx = mesh.indices();
     auto v = mesh.verts();
 
@@ -534,6 +539,7 @@ std::string Halfedge_Mesh::from_mesh(const GL::Mesh& mesh) {
 
 bool Halfedge_Mesh::subdivide(SubD strategy) {
 
+    Profiler::Zone zone("Halfedge_Mesh::subdivide");
     std::vector<std::vector<Index>> polys;
     std::vector<Vec3> verts;
     std::unordered_map<unsigned int, Index> layout;
@@ -0,0 +1,90 @@
+#include <sf_libs/stb_image_write.h>
+
+#include "frame_writer.h"
+
+namespace Gui {
+
+static bool has_extension(const std::string& path, const std::string& ext) {
+    return path.length() >= ext.length() &&
+           path.compare(path.length() - ext.length(), ext.length(), ext) == 0;
+}
+
+std::string save_image(const HDR_Image& image, const std::string& path, float exposure) {
+
+    if(has_extension(path, ".exr")) return image.save_exr(path);
+    if(has_extension(path, ".pfm")) return image.save_pfm(path);
+
+    auto [w, h] = image.dimension();
+    std::vector<unsigned char> data;
+    image.tonemap_to(data, exposure);
+    stbi_flip_vertically_on_write(false);
+    if(!stbi_write_png(path.c_str(), (int)w, (int)h, 4, data.data(), (int)w * 4)) {
+        return "Failed to write output!";
+    }
+    return {};
+}
+
+Frame_Writer::Frame_Writer(size_t max_pending)
+    : max_pending(std::max(max_pending, size_t(1))), worker([this] { run(); }) {
+}
+
+Frame_Writer::~Frame_Writer() {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        stop = true;
+    }
+    cond.notify_all();
+    worker.join();
+}
+
+void Frame_Writer::push(Frame&& frame) {
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        cond.wait(lock, [this] { return frames.size() < max_pending; });
+        frames.push(std::move(frame));
+    }
+    cond.notify_all();
+}
+
+std::string Frame_Writer::error() {
+    std::lock_guard<std::mutex> lock(mut);
+    std::string ret = std::move(first_error);
+    first_error.clear();
+    return ret;
+}
+
+std::string Frame_Writer::flush() {
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        cond.wait(lock, [this] { return frames.empty() && !busy; });
+    }
+    return error();
+}
+
+void Frame_Writer::run() {
+
+    for(;;) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(mut);
+            cond.wait(lock, [this] { return stop || !frames.empty(); });
+            if(frames.empty()) return;
+            frame = std::move(frames.front());
+            frames.pop();
+            busy = true;
+        }
+        cond.notify_all();
+
+        std::string err = save_image(frame.image, frame.path, frame.exposure);
+        if(err.empty() && !frame.aov_path.empty()) err = frame.aovs.save_exr(frame.aov_path);
+
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            busy = false;
+            if(first_error.empty()) first_error = err;
+        }
+        cond.notify_all();
+    }
+}
+
+} // namespace Gui
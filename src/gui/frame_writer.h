@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+#include "../rays/aov.h"
+#include "../util/hdr_image.h"
+
+namespace Gui {
+
+// Writes an image to path, choosing the format from its extension: .exr and
+// .pfm keep raw float radiance, anything else is tonemapped to PNG.
+std::string save_image(const HDR_Image& image, const std::string& path, float exposure);
+
+// Encodes finished frames on a background thread so the next frame can start
+// tracing right away. At most max_pending frames wait in the queue; push()
+// blocks until there is room.
+class Frame_Writer {
+public:
+    struct Frame {
+        std::string path;
+        HDR_Image image;
+        float exposure = 1.0f;
+
+        // Written to aov_path if non-empty
+        std::string aov_path;
+        PT::AOV_Buffers aovs;
+    };
+
+    Frame_Writer(size_t max_pending = 2);
+    ~Frame_Writer();
+
+    void push(Frame&& frame);
+
+    /// First error reported since the last call, if any
+    std::string error();
+    /// Wait for all queued frames to be written and return the first error
+    std::string flush();
+
+private:
+    void run();
+
+    size_t max_pending;
+    bool stop = false, busy = false;
+    std::string first_error;
+
+    std::mutex mut;
+    std::condition_variable cond;
+    std::queue<Frame> frames;
+    std::thread worker;
+};
+
+} // namespace Gui
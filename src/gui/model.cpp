@@ -9,6 +9,7 @@
 #include "../geometry/util.h"
 #include "../scene/renderer.h"
 #include "../scene/undo.h"
+#include "../util/profiler.h"
 
 namespace Gui {
 
@@ -510,6 +511,7 @@ template<typename T>
 std::string Model::update_mesh(Undo& undo, Scene_Object& obj, Halfedge_Mesh&& before,
                                Halfedge_Mesh::ElementRef ref, T&& op) {
 
+    Profiler::Zone zone("Local mesh operation");
     unsigned int id = Halfedge_Mesh::id_of(ref);
     std::optional<Halfedge_Mesh::ElementRef> new_ref = op(*my_mesh, ref);
     if(!new_ref.has_value()) return {};
@@ -531,6 +533,7 @@ template<typename T>
 std::string Model::update_mesh_global(Undo& undo, Scene_Object& obj, Halfedge_Mesh&& before,
                                       T&& op) {
 
+    Profiler::Zone zone("Global mesh operation");
     bool suc = op(*my_mesh);
     if(!suc) return {};
 
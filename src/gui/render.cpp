@@ -32,7 +32,7 @@ void Render::render(Scene_Maybe obj_opt, Widgets& widgets, Camera& user_cam) {
 
         ui_camera.render(view);
 
-        if(render_ray_log && !ui_render.in_progress()) {
+        if(render_ray_log) {
             ui_render.render_log(view);
         }
 
@@ -100,10 +100,18 @@ Mode Render::UIsidebar(Manager& manager, Undo& undo, Scene& scene, Scene_Maybe o
 
     ImGui::Text("Visualize");
 
+    // Rays are only logged while they are shown
     ImGui::Checkbox("Logged rays", &render_ray_log);
-    ImGui::Checkbox("BVH", &visualize_bvh);
+    if(render_ray_log) {
+        ImGui::InputInt("Log 1 in", &log_every);
+        ImGui::InputInt("Max rays", &log_cap, 1000, 10000);
+        log_every = std::max(log_every, 1);
+        log_cap = std::max(log_cap, 1);
+    }
+    ui_render.tracer().get_ray_log().set(render_ray_log ? (size_t)log_every : 0, (size_t)log_cap);
 
-    bool update_bvh = false;
+    // Only walk the BVH when it is shown, so starting a render doesn't wait for its build
+    bool update_bvh = ImGui::Checkbox("BVH", &visualize_bvh);
 
     if(visualize_bvh) {
         if(ImGui::SliderInt("Level", &bvh_level, 0, (int)bvh_levels)) {
@@ -116,7 +124,7 @@ Mode Render::UIsidebar(Manager& manager, Undo& undo, Scene& scene, Scene_Maybe o
     update_bvh = update_bvh || ui_render.UI(scene, ui_camera, user_cam, err);
     manager.set_error(err);
 
-    if(update_bvh) {
+    if(update_bvh && visualize_bvh) {
         update_bvh = false;
         bvh_viz.clear();
         bvh_active.clear();
@@ -133,12 +141,30 @@ std::pair<float, float> Render::completion_time() const {
     return ui_render.completion_time();
 }
 
+const PT::Ray_Stats& Render::stats() const {
+    return ui_render.stats();
+}
+
+PT::Pathtracer& Render::tracer() {
+    return ui_render.tracer();
+}
+
+std::string Render::benchmark_roulette(Scene& scene, int w, int h, int s, int ls, int d,
+                                       bool w_from_ar, int min_depth) {
+    if(w_from_ar) {
+        w = (int)std::ceil(ui_camera.get_ar() * h);
+    }
+    return ui_render.benchmark_roulette(scene, ui_camera.get(), w, h, s, ls, d, min_depth);
+}
+
 std::string Render::headless_render(Animate& animate, Scene& scene, std::string output, bool a,
-                                    int w, int h, int s, int ls, int d, float exp, bool w_from_ar) {
+                                    int w, int h, int s, int ls, int d, float exp, bool w_from_ar,
+                                    float budget, int pipeline_depth, int pipeline_memory) {
     if(w_from_ar) {
         w = (int)std::ceil(ui_camera.get_ar() * h);
     }
-    return ui_render.headless(animate, scene, ui_camera.get(), output, a, w, h, s, ls, d, exp);
+    return ui_render.headless(animate, scene, ui_camera.get(), output, a, w, h, s, ls, d, exp,
+                              budget, pipeline_depth, pipeline_memory);
 }
 
 } // namespace Gui
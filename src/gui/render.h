@@ -21,8 +21,14 @@ public:
     Render(Scene& scene, Vec2 dim);
 
     std::string headless_render(Animate& animate, Scene& scene, std::string output, bool a, int w,
-                                int h, int s, int ls, int d, float exp, bool w_from_ar);
+                                int h, int s, int ls, int d, float exp, bool w_from_ar,
+                                float budget = 0.0f, int pipeline_depth = 0,
+                                int pipeline_memory = 0);
+    std::string benchmark_roulette(Scene& scene, int w, int h, int s, int ls, int d, bool w_from_ar,
+                                   int min_depth);
     std::pair<float, float> completion_time() const;
+    const PT::Ray_Stats& stats() const;
+    PT::Pathtracer& tracer();
 
     bool keydown(Widgets& widgets, SDL_Keysym key);
     Mode UIsidebar(Manager& manager, Undo& undo, Scene& scene, Scene_Maybe selected,
@@ -41,6 +47,7 @@ private:
 
     // GUI Data
     bool render_ray_log = false;
+    int log_every = 1, log_cap = 100000;
     bool visualize_bvh = false;
     int bvh_level = 0;
     size_t bvh_levels = 0;
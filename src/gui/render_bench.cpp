@@ -0,0 +1,422 @@
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "../geometry/util.h"
+#include "../scene/undo.h"
+#include "manager.h"
+#include "render_bench.h"
+
+namespace Gui {
+
+// References are rendered at this many times the benchmark's sample count
+static const int reference_scale = 8;
+
+struct Bench_Result {
+    std::string name;
+    std::string error;
+    int depth = 0;
+    PT::Ray_Stats stats;
+    size_t samples = 0, peak_rss = 0;
+    float rmse = 0.0f, rel_mse = 0.0f;
+    bool new_reference = false;
+};
+
+// Restarts the peak RSS count where the OS allows it, so each scene reports its own peak
+static void reset_peak_rss() {
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+// Largest resident set since the last reset, in bytes; 0 if unknown
+static size_t peak_rss() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) return std::stoull(line.substr(6)) * 1024;
+    }
+    return 0;
+#elif defined(__APPLE__)
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (size_t)usage.ru_maxrss : 0;
+#elif !defined(_WIN32)
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (size_t)usage.ru_maxrss * 1024 : 0;
+#else
+    return 0;
+#endif
+}
+
+//////////////////////////////////////////////////////////////
+// Generated scenes
+//////////////////////////////////////////////////////////////
+
+// Scenes are built from their own generator, so they are the same on every run
+using Gen_RNG = std::mt19937;
+
+static float gen_unit(Gen_RNG& rng) {
+    return std::uniform_real_distribution<float>(0.0f, 1.0f)(rng);
+}
+
+static Spectrum gen_color(Gen_RNG& rng) {
+    return Spectrum(0.2f + 0.8f * gen_unit(rng), 0.2f + 0.8f * gen_unit(rng),
+                    0.2f + 0.8f * gen_unit(rng));
+}
+
+static Scene_Object& add_mesh(Scene& scene, Pose pose, GL::Mesh&& mesh, std::string name,
+                              Spectrum albedo = Spectrum(0.8f)) {
+    Scene_Object& obj = scene.get_obj(scene.add(pose, std::move(mesh), name));
+    obj.material.opt.albedo = albedo;
+    return obj;
+}
+
+static Scene_Object& add_sphere(Scene& scene, Vec3 pos, float r, std::string name) {
+    Scene_Object obj(scene.reserve_id(), Pose::moved(pos), GL::Mesh(), name);
+    obj.opt.shape_type = PT::Shape_Type::sphere;
+    obj.opt.shape = PT::Shape(PT::Sphere(r));
+    return scene.get_obj(scene.add(std::move(obj)));
+}
+
+static void add_light(Scene& scene, Light_Type type, Pose pose, Spectrum color, float intensity) {
+    Scene_Light light(type, scene.reserve_id(), pose);
+    light.opt.spectrum = color;
+    light.opt.intensity = intensity;
+    light.dirty();
+    scene.add(std::move(light));
+}
+
+static Pose pointing(Vec3 dir) {
+    return Pose::rotated(Mat4::rotate_to(dir.unit()).to_euler());
+}
+
+// A few objects on a floor, lit only by a grid of hundreds of small point lights
+static void gen_lights(Scene& scene, Render& render, Gen_RNG& rng) {
+
+    static const int grid = 24;
+
+    add_mesh(scene, Pose::id(), Util::square_mesh(12.0f), "Floor");
+    for(int i = 0; i < 5; i++) {
+        add_sphere(scene, Vec3(-4.0f + 2.0f * i, 0.8f, 0.0f), 0.8f, "Sphere")
+            .material.opt.albedo = gen_color(rng);
+    }
+    for(int i = 0; i < grid; i++) {
+        for(int j = 0; j < grid; j++) {
+            Vec3 pos(-10.0f + 20.0f * (i + gen_unit(rng)) / grid, 1.0f + 3.0f * gen_unit(rng),
+                     -10.0f + 20.0f * (j + gen_unit(rng)) / grid);
+            add_light(scene, Light_Type::point, Pose::moved(pos), gen_color(rng), 0.5f);
+        }
+    }
+    render.load_cam(Vec3(0.0f, 7.0f, 13.0f), Vec3(0.0f, 0.5f, 0.0f), 0.0f, Radians(60.0f), 0.0f,
+                    14.0f);
+}
+
+// Thousands of small objects, each its own entry in the top-level BVH
+static void gen_instances(Scene& scene, Render& render, Gen_RNG& rng) {
+
+    static const int grid = 64;
+    static const float spacing = 0.5f;
+
+    add_mesh(scene, Pose::id(), Util::square_mesh(20.0f), "Floor");
+    for(int i = 0; i < grid; i++) {
+        for(int j = 0; j < grid; j++) {
+            float r = spacing * (0.15f + 0.2f * gen_unit(rng));
+            Vec3 pos((i - grid / 2) * spacing, r, (j - grid / 2) * spacing);
+            Spectrum color = gen_color(rng);
+            if((i + j) % 2) {
+                add_sphere(scene, pos, r, "Sphere").material.opt.albedo = color;
+            } else {
+                Pose pose = Pose::moved(pos);
+                pose.euler.y = 90.0f * gen_unit(rng);
+                add_mesh(scene, pose, Util::cube_mesh(r), "Cube", color);
+            }
+        }
+    }
+    add_light(scene, Light_Type::hemisphere, Pose::id(), Spectrum(0.6f, 0.7f, 1.0f), 1.0f);
+    add_light(scene, Light_Type::directional, pointing(Vec3(-1.0f, -2.0f, -1.0f)),
+              Spectrum(1.0f, 0.9f, 0.8f), 2.0f);
+    render.load_cam(Vec3(0.0f, 9.0f, 18.0f), Vec3(0.0f, 0.0f, 0.0f), 0.0f, Radians(50.0f), 0.0f,
+                    20.0f);
+}
+
+// Nested glass shells and a row of glass blocks, so paths refract many times
+static void gen_glass(Scene& scene, Render& render, Gen_RNG& rng) {
+
+    static const int shells = 6;
+
+    add_mesh(scene, Pose::id(), Util::square_mesh(10.0f), "Floor");
+    for(int i = 0; i < shells; i++) {
+        float r = 2.0f * (1.0f - 0.1f * i);
+        Scene_Object& obj = add_sphere(scene, Vec3(0.0f, 2.0f, 0.0f), r, "Shell");
+        obj.material.opt.type = Material_Type::glass;
+        obj.material.opt.ior = 1.5f;
+    }
+    for(int i = 0; i < 6; i++) {
+        Pose pose = Pose::moved(Vec3(-3.75f + 1.5f * i, 0.5f, 3.0f));
+        pose.euler.y = 45.0f * gen_unit(rng);
+        Scene_Object& obj = add_mesh(scene, pose, Util::cube_mesh(0.5f), "Block");
+        obj.material.opt.type = Material_Type::glass;
+        obj.material.opt.ior = 1.3f + 0.1f * i;
+    }
+    add_light(scene, Light_Type::hemisphere, Pose::id(), Spectrum(1.0f), 1.0f);
+    add_light(scene, Light_Type::point, Pose::moved(Vec3(3.0f, 6.0f, 2.0f)), Spectrum(1.0f), 20.0f);
+    render.load_cam(Vec3(0.0f, 3.0f, 9.0f), Vec3(0.0f, 1.5f, 0.0f), 0.0f, Radians(55.0f), 0.0f,
+                    9.0f);
+}
+
+// One large fractal height field seen from low above its surface
+static void gen_landscape(Scene& scene, Render& render, Gen_RNG& rng) {
+
+    static const int size = 512, octaves = 7;
+    static const float extent = 100.0f, height = 12.0f;
+
+    // Value noise on a lattice per octave, halving the amplitude as the frequency doubles
+    std::vector<float> heights(size * size, 0.0f);
+    float amplitude = 1.0f;
+    for(int o = 0, cells = 4; o < octaves; o++, cells *= 2, amplitude *= 0.5f) {
+        std::vector<float> lattice((cells + 1) * (cells + 1));
+        for(float& v : lattice) v = gen_unit(rng);
+        auto corner = [&](int x, int y) { return lattice[x * (cells + 1) + y]; };
+
+        for(int x = 0; x < size; x++) {
+            for(int y = 0; y < size; y++) {
+                float fx = (float)x * cells / (size - 1), fy = (float)y * cells / (size - 1);
+                int ix = std::min((int)fx, cells - 1), iy = std::min((int)fy, cells - 1);
+                float tx = smoothstep(0.0f, 1.0f, fx - ix), ty = smoothstep(0.0f, 1.0f, fy - iy);
+                float a = lerp(corner(ix, iy), corner(ix + 1, iy), tx);
+                float b = lerp(corner(ix, iy + 1), corner(ix + 1, iy + 1), tx);
+                heights[x * size + y] += amplitude * lerp(a, b, ty);
+            }
+        }
+    }
+
+    float step = extent / (size - 1);
+    auto at = [&](int x, int y) {
+        x = clamp(x, 0, size - 1);
+        y = clamp(y, 0, size - 1);
+        return height * heights[x * size + y];
+    };
+
+    Util::Gen::Data land;
+    for(int x = 0; x < size; x++) {
+        for(int y = 0; y < size; y++) {
+            Vec3 pos(x * step - extent / 2.0f, at(x, y), y * step - extent / 2.0f);
+            Vec3 norm(at(x - 1, y) - at(x + 1, y), 2.0f * step, at(x, y - 1) - at(x, y + 1));
+            land.verts.push_back({pos, norm.unit(), 0});
+            if(x + 1 < size && y + 1 < size) {
+                GL::Mesh::Index i = x * size + y;
+                land.elems.insert(land.elems.end(),
+                                  {i, i + 1, i + size, i + 1, i + size + 1, i + size});
+            }
+        }
+    }
+    add_mesh(scene, Pose::id(), GL::Mesh(std::move(land.verts), std::move(land.elems)), "Landscape",
+             Spectrum(0.45f, 0.5f, 0.35f));
+
+    add_light(scene, Light_Type::hemisphere, Pose::id(), Spectrum(0.5f, 0.65f, 1.0f), 1.0f);
+    add_light(scene, Light_Type::directional, pointing(Vec3(1.0f, -0.6f, 0.5f)),
+              Spectrum(1.0f, 0.9f, 0.75f), 3.0f);
+    render.load_cam(Vec3(-45.0f, at(size / 20, size / 2) + 8.0f, 0.0f),
+                    Vec3(20.0f, height * 0.5f, 0.0f), 0.0f, Radians(70.0f), 0.0f, 60.0f);
+}
+
+struct Generated {
+    const char* name;
+    int min_depth;
+    void (*build)(Scene& scene, Render& render, Gen_RNG& rng);
+};
+
+static const Generated generated[] = {{"many_lights", 0, gen_lights},
+                                      {"many_instances", 0, gen_instances},
+                                      {"deep_glass", 16, gen_glass},
+                                      {"landscape", 0, gen_landscape}};
+
+//////////////////////////////////////////////////////////////
+// Driver
+//////////////////////////////////////////////////////////////
+
+static std::string file_stem(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return name.substr(0, name.find_last_of('.'));
+}
+
+static void trace(PT::Pathtracer& tracer, Scene& scene, const Camera& cam,
+                  const Render_Bench& bench, int samples, int depth, unsigned int seed) {
+    tracer.set_seed(seed);
+    tracer.set_sizes(bench.w, bench.h, samples, bench.ls, depth);
+    tracer.begin_render(scene, cam);
+    tracer.wait();
+}
+
+static void run_scene(Render& render, Scene& scene, const Render_Bench& bench,
+                      Bench_Result& result) {
+
+    PT::Pathtracer& tracer = render.tracer();
+    const Camera& cam = render.get_cam();
+    std::string ref_path = bench.references + "/" + result.name + ".exr";
+
+    // The reference gets its own seed, so its noise is independent of the render's
+    HDR_Image reference;
+    if(!reference.load_from(ref_path).empty()) {
+        info("Rendering reference for %s...", result.name.c_str());
+        trace(tracer, scene, cam, bench, bench.s * reference_scale, result.depth, ~bench.seed);
+        reference = tracer.get_raw_output().copy();
+        result.error = reference.save_exr(ref_path);
+        if(!result.error.empty()) return;
+        result.new_reference = true;
+    }
+
+    reset_peak_rss();
+    trace(tracer, scene, cam, bench, bench.s, result.depth, bench.seed);
+    result.peak_rss = peak_rss();
+    result.stats = tracer.stats();
+    result.samples = (size_t)bench.w * bench.h * bench.s;
+
+    const HDR_Image& output = tracer.get_raw_output();
+    if(output.dimension() != reference.dimension()) {
+        result.error = "Reference " + ref_path + " has a different size; delete it to re-render.";
+        return;
+    }
+    result.rmse = output.rmse(reference);
+    result.rel_mse = output.rel_mse(reference);
+}
+
+// Quoted JSON string; names and errors hold paths and user text
+static std::string json_string(const std::string& str) {
+    std::stringstream out;
+    out << '"';
+    for(char c : str) {
+        switch(c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if((unsigned char)c < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c
+                    << std::dec << std::setfill(' ');
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+static std::string to_json(const Render_Bench& bench, const std::vector<Bench_Result>& results) {
+
+    std::stringstream out;
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"width\": " << bench.w << ",\n";
+    out << "  \"height\": " << bench.h << ",\n";
+    out << "  \"samples\": " << bench.s << ",\n";
+    out << "  \"seed\": " << bench.seed << ",\n";
+    out << "  \"scenes\": [";
+    for(size_t i = 0; i < results.size(); i++) {
+        const Bench_Result& r = results[i];
+        double rate = r.stats.render_time > 0.0 ? 1.0 / r.stats.render_time : 0.0;
+        out << (i ? "," : "") << "\n    {\n";
+        out << "      \"name\": " << json_string(r.name) << ",\n";
+        if(!r.error.empty()) {
+            out << "      \"error\": " << json_string(r.error) << "\n    }";
+            continue;
+        }
+        out << "      \"depth\": " << r.depth << ",\n";
+        out << std::setprecision(3);
+        out << "      \"build_time\": " << r.stats.build_time << ",\n";
+        out << "      \"render_time\": " << r.stats.render_time << ",\n";
+        out << "      \"trace_time\": " << r.stats.trace_time << ",\n";
+        out << "      \"samples_per_second\": " << r.samples * rate << ",\n";
+        out << "      \"rays_per_second\": " << r.stats.rays() * rate << ",\n";
+        out << "      \"peak_rss_mb\": " << r.peak_rss / (1024.0 * 1024.0) << ",\n";
+        out << std::setprecision(8);
+        out << "      \"rmse\": " << r.rmse << ",\n";
+        out << "      \"rel_mse\": " << r.rel_mse << ",\n";
+        out << "      \"new_reference\": " << (r.new_reference ? "true" : "false") << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+std::string render_bench(Manager& gui, Undo& undo, Scene& scene, const Render_Bench& bench) {
+
+    info("Render benchmark settings:");
+    info("\twidth: %d", bench.w);
+    info("\theight: %d", bench.h);
+    info("\tsamples: %d (reference: %d)", bench.s, bench.s * reference_scale);
+    info("\tlight samples: %d", bench.ls);
+    info("\tmax depth: %d", bench.d);
+    info("\tseed: %u", bench.seed);
+    info("\treferences: %s", bench.references.c_str());
+
+    std::error_code fs_err;
+    std::filesystem::create_directories(bench.references, fs_err);
+    if(fs_err) return "Could not create " + bench.references + ": " + fs_err.message();
+
+    Render& render = gui.get_render();
+    PT::Pathtracer& tracer = render.tracer();
+    tracer.set_time_budget(0.0f);
+
+    std::vector<Bench_Result> results;
+
+    for(const std::string& file : bench.scene_files) {
+        Bench_Result result;
+        result.name = file_stem(file);
+        result.depth = bench.d;
+
+        Scene::Load_Opts opts;
+        opts.new_scene = true;
+        result.error = scene.load(opts, undo, gui, file);
+        if(result.error.empty()) run_scene(render, scene, bench, result);
+        results.push_back(std::move(result));
+    }
+
+    for(const Generated& gen : generated) {
+        Bench_Result result;
+        result.name = gen.name;
+        result.depth = std::max(bench.d, gen.min_depth);
+
+        scene.clear(undo);
+        Gen_RNG rng(bench.seed);
+        gen.build(scene, render, rng);
+        run_scene(render, scene, bench, result);
+        results.push_back(std::move(result));
+    }
+    scene.clear(undo);
+    tracer.set_seed(0);
+
+    info("%-16s %8s %8s %12s %10s %9s %10s %10s", "scene", "build", "render", "Msamples/s",
+         "Mrays/s", "peak MB", "RMSE", "relMSE");
+    for(const Bench_Result& r : results) {
+        if(!r.error.empty()) {
+            warn("%-16s %s", r.name.c_str(), r.error.c_str());
+            continue;
+        }
+        double rate = 1.0 / std::max(r.stats.render_time, 1e-6);
+        info("%-16s %7.2fs %7.2fs %12.3f %10.3f %9.1f %10.6f %10.6f%s", r.name.c_str(),
+             r.stats.build_time, r.stats.render_time, r.samples * rate / 1e6,
+             r.stats.rays() * rate / 1e6, r.peak_rss / (1024.0 * 1024.0), r.rmse, r.rel_mse,
+             r.new_reference ? "  (new reference)" : "");
+    }
+
+    if(!bench.report_file.empty()) {
+        std::ofstream out(bench.report_file);
+        out << to_json(bench, results);
+        if(!out) return "Could not write " + bench.report_file;
+    }
+    return {};
+}
+
+} // namespace Gui
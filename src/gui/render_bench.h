@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class Scene;
+class Undo;
+
+namespace Gui {
+
+class Manager;
+
+// Renders a fixed corpus of scenes headlessly so runs can be compared over time:
+// the scene files (media/model.dae unless others are given), then generated scenes that stress many lights, many
+// instances, deep glass and a big landscape. Every render uses the same seed.
+// Each result is compared to <references>/<name>.exr, which is rendered at a
+// higher sample count and written the first time a scene is benchmarked.
+struct Render_Bench {
+    std::vector<std::string> scene_files = {"media/model.dae"};
+    std::string references = "references";
+    std::string report_file; // JSON, if non-empty
+
+    int w = 640, h = 360, s = 128, ls = 16, d = 4;
+    unsigned int seed = 1;
+};
+
+std::string render_bench(Manager& gui, Undo& undo, Scene& scene, const Render_Bench& bench);
+
+} // namespace Gui
@@ -0,0 +1,66 @@
+#include "scene_pipeline.h"
+#include "animate.h"
+
+namespace Gui {
+
+Scene_Pipeline::Scene_Pipeline(Animate& animate, Scene& scene, const PT::Pathtracer& tracer,
+                               int n_frames, size_t depth, size_t max_bytes)
+    : animate(animate), scene(scene), tracer(tracer), n_frames(n_frames),
+      depth(std::max(depth, size_t(1))), max_bytes(max_bytes), worker([this] { run(); }) {
+}
+
+Scene_Pipeline::~Scene_Pipeline() {
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        stop = true;
+    }
+    cond.notify_all();
+    worker.join();
+}
+
+bool Scene_Pipeline::has_room() const {
+    if(ready.empty()) return true;
+    return ready.size() < depth && ready_bytes + last_bytes <= max_bytes;
+}
+
+bool Scene_Pipeline::next(Frame& frame) {
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        if(handed_out == n_frames) return false;
+        cond.wait(lock, [this] { return !ready.empty(); });
+        frame = std::move(ready.front());
+        ready.pop();
+        ready_bytes -= frame.data.bytes;
+        handed_out++;
+    }
+    cond.notify_all();
+    return true;
+}
+
+void Scene_Pipeline::run() {
+
+    for(int i = 0; i < n_frames; i++) {
+        {
+            std::unique_lock<std::mutex> lock(mut);
+            cond.wait(lock, [this] { return stop || has_room(); });
+            if(stop) return;
+        }
+
+        // Simulation state carries over between frames, so frames are built in order
+        Frame frame;
+        frame.index = i;
+        frame.cam = animate.set_time(scene, (float)i);
+        animate.step_sim(scene);
+        frame.data = tracer.prepare_scene(scene);
+
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            last_bytes = frame.data.bytes;
+            ready_bytes += frame.data.bytes;
+            ready.push(std::move(frame));
+        }
+        cond.notify_all();
+    }
+}
+
+} // namespace Gui
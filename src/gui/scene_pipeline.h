@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include "../rays/pathtracer.h"
+#include "../scene/scene.h"
+#include "../util/camera.h"
+
+namespace Gui {
+
+class Animate;
+
+// Prepares animation frames on a background thread so that posing, simulation
+// and BVH builds for the next frames overlap tracing the current one. At most
+// depth frames are kept ready, and a new one is only started while the ready
+// frames are expected to stay under max_bytes (one frame is always allowed).
+// The layout scene belongs to the pipeline until it is destroyed.
+class Scene_Pipeline {
+public:
+    struct Frame {
+        int index = 0;
+        Camera cam = Camera(Vec2{1.0f});
+        PT::Scene_Data data;
+    };
+
+    Scene_Pipeline(Animate& animate, Scene& scene, const PT::Pathtracer& tracer, int n_frames,
+                   size_t depth, size_t max_bytes);
+    ~Scene_Pipeline();
+
+    /// Wait for the next frame in order; false once every frame has been handed out
+    bool next(Frame& frame);
+
+private:
+    void run();
+    bool has_room() const;
+
+    Animate& animate;
+    Scene& scene;
+    const PT::Pathtracer& tracer;
+    int n_frames, handed_out = 0;
+    size_t depth, max_bytes;
+
+    bool stop = false;
+    size_t ready_bytes = 0, last_bytes = 0;
+    std::queue<Frame> ready;
+
+    std::mutex mut;
+    std::condition_variable cond;
+    std::thread worker;
+};
+
+} // namespace Gui
@@ -10,13 +10,11 @@ namespace Gui {
 const char* Solid_Type_Names[(int)Solid_Type::count] = {"Sphere", "Cube", "Cylinder", "Torus",
                                                         "Custom"};
 
-Simulate::Simulate() : thread_pool(std::thread::hardware_concurrency()) {
+Simulate::Simulate() : thread_pool(Thread_Pool::shared()) {
     last_update = SDL_GetPerformanceCounter();
 }
 
 Simulate::~Simulate() {
-    thread_pool.wait();
-    thread_pool.stop();
 }
 
 bool Simulate::keydown(Widgets& widgets, Undo& undo, SDL_Keysym key) {
@@ -83,11 +81,13 @@ void Simulate::build_scene(Scene& scene) {
 
     std::mutex obj_mut;
     std::vector<PT::Object> obj_list;
+    // Interactive, so it isn't queued behind a running render
+    Task_Group group(thread_pool, Priority::interactive);
 
     scene.for_items([&, this](Scene_Item& item) {
         if(item.is<Scene_Object>()) {
             Scene_Object& obj = item.get<Scene_Object>();
-            thread_pool.enqueue([&]() {
+            group.run([&]() {
                 if(obj.is_shape()) {
                     PT::Shape shape(obj.opt.shape);
                     std::lock_guard<std::mutex> lock(obj_mut);
@@ -112,7 +112,7 @@ void Simulate::build_scene(Scene& scene) {
         }
     });
 
-    thread_pool.wait();
+    group.wait();
     scene_bvh.build(std::move(obj_list));
 }
 
@@ -36,7 +36,7 @@ public:
 
 private:
     PT::BVH<PT::Object> scene_bvh;
-    Thread_Pool thread_pool;
+    Thread_Pool& thread_pool;
     Pose old_pose;
     size_t cur_actions = 0;
     Uint64 last_update;
@@ -560,11 +560,6 @@ void Widget_Render::open() {
     render_window_focus = true;
 }
 
-void Widget_Render::log_ray(const Ray& ray, float t, Spectrum color) {
-    std::lock_guard<std::mutex> lock(log_mut);
-    ray_log.add(ray.point, ray.at(t), Vec3(color.r, color.g, color.b));
-}
-
 void Widget_Render::begin(Scene& scene, Widget_Camera& cam, Camera& user_cam) {
 
     if(render_window_focus) {
@@ -584,6 +579,12 @@ void Widget_Render::begin(Scene& scene, Widget_Camera& cam, Camera& user_cam) {
         ImGui::InputInt("Samples", &out_samples, 1, 100);
         ImGui::InputInt("Area Light Samples", &out_area_samples, 1, 100);
         ImGui::InputInt("Max Ray Depth", &out_depth, 1, 32);
+        ImGui::Combo("Roulette", &out_roulette, PT::Roulette_Policy_Names,
+                     (int)PT::Roulette_Policy::count);
+        ImGui::InputInt("Roulette Min Depth", &out_roulette_depth, 1, 4);
+        ImGui::Combo("MIS", &out_mis, PT::MIS_Mode_Names, (int)PT::MIS_Mode::count);
+        ImGui::Checkbox("Path Guiding", &out_guiding);
+        ImGui::Checkbox("Denoise", &out_denoise);
         ImGui::SliderFloat("Exposure", &exposure, 0.01f, 10.0f, "%.2f", 2.5f);
     } else {
         ImGui::Combo("Samples", (int*)&msaa.samples, GL::Sample_Count_Names, msaa.n_options());
@@ -595,6 +596,7 @@ void Widget_Render::begin(Scene& scene, Widget_Camera& cam, Camera& user_cam) {
     out_samples = std::max(1, out_samples);
     out_area_samples = std::max(1, out_area_samples);
     out_depth = std::max(1, out_depth);
+    out_roulette_depth = std::max(0, out_roulette_depth);
 
     if(ImGui::Button("Set Width via AR")) {
         out_w = (size_t)std::ceil(cam.get_ar() * out_h);
@@ -605,35 +607,55 @@ void Widget_Render::begin(Scene& scene, Widget_Camera& cam, Camera& user_cam) {
     }
 }
 
+bool postfix(const std::string& path, const std::string& type) {
+    if(path.length() >= type.length())
+        return path.compare(path.length() - type.length(), type.length(), type) == 0;
+    return false;
+}
+
+// AOVs are written next to the beauty image as <name>.aovs.exr
+static std::string aov_path(const std::string& image) {
+    size_t slash = image.find_last_of("/\\");
+    size_t dot = image.find_last_of('.');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return image + ".aovs.exr";
+    }
+    return image.substr(0, dot) + ".aovs.exr";
+}
+
+static std::string frame_path(const std::string& folder, int frame) {
+    std::stringstream str;
+    str << std::setfill('0') << std::setw(4) << frame;
+#ifdef _WIN32
+    return folder + "\\" + str.str() + ".png";
+#else
+    return folder + "/" + str.str() + ".png";
+#endif
+}
+
 std::string Widget_Render::step(Animate& animate, Scene& scene) {
 
     if(animating) {
 
         if(next_frame == max_frame) {
             animating = false;
-            return {};
+            return writer.flush();
         }
         if(folder.empty()) {
             animating = false;
             return "No output folder!";
         }
 
-        Camera cam = animate.set_time(scene, (float)next_frame);
-        animate.step_sim(scene);
-
         if(method == 0) {
             std::vector<unsigned char> data;
 
+            Camera cam = animate.set_time(scene, (float)next_frame);
+            animate.step_sim(scene);
+
             Renderer::get().save(scene, cam, out_w, out_h, out_samples);
             Renderer::get().saved(data);
 
-            std::stringstream str;
-            str << std::setfill('0') << std::setw(4) << next_frame;
-#ifdef _WIN32
-            std::string path = folder + "\\" + str.str() + ".png";
-#else
-            std::string path = folder + "/" + str.str() + ".png";
-#endif
+            std::string path = frame_path(folder, next_frame);
 
             stbi_flip_vertically_on_write(true);
             if(!stbi_write_png(path.c_str(), (int)out_w, (int)out_h, 4, data.data(),
@@ -645,32 +667,32 @@ std::string Widget_Render::step(Animate& animate, Scene& scene) {
             next_frame++;
         } else {
 
+            // Pose and simulate each frame once, right before it starts tracing
             if(init) {
+                Camera cam = animate.set_time(scene, (float)next_frame);
+                animate.step_sim(scene);
                 pathtracer.begin_render(scene, cam);
                 init = false;
             }
 
             if(!pathtracer.in_progress()) {
-                std::vector<unsigned char> data;
-
-                pathtracer.get_output().tonemap_to(data, exposure);
-                std::stringstream str;
-                str << std::setfill('0') << std::setw(4) << next_frame;
-#ifdef _WIN32
-                std::string path = folder + "\\" + str.str() + ".png";
-#else
-                std::string path = folder + "/" + str.str() + ".png";
-#endif
 
-                stbi_flip_vertically_on_write(false);
-                if(!stbi_write_png(path.c_str(), (int)out_w, (int)out_h, 4, data.data(),
-                                   (int)out_w * 4)) {
+                std::string err = writer.error();
+                if(!err.empty()) {
                     animating = false;
-                    return "Failed to write output!";
+                    return err;
                 }
 
-                pathtracer.begin_render(scene, cam);
+                // Hand the finished frame to the writer thread and start tracing
+                // the next one while it is encoded.
+                push_frame(frame_path(folder, next_frame));
+
                 next_frame++;
+                if(next_frame < max_frame) {
+                    Camera cam = animate.set_time(scene, (float)next_frame);
+                    animate.step_sim(scene);
+                    pathtracer.begin_render(scene, cam);
+                }
             }
         }
     }
@@ -720,8 +742,13 @@ void Widget_Render::animate(Scene& scene, Widget_Camera& cam, Camera& user_cam,
             folder = std::string(output_path);
             if(method == 1) {
                 init = true;
-                ray_log.clear();
+                clear_log();
                 pathtracer.set_sizes(out_w, out_h, out_samples, out_area_samples, out_depth);
+                pathtracer.set_roulette((PT::Roulette_Policy)out_roulette,
+                                        (size_t)out_roulette_depth);
+                pathtracer.set_mis((PT::MIS_Mode)out_mis);
+                pathtracer.set_guiding(out_guiding);
+                pathtracer.set_denoise(out_denoise);
             }
         }
     }
@@ -741,12 +768,6 @@ void Widget_Render::animate(Scene& scene, Widget_Camera& cam, Camera& user_cam,
     ImGui::End();
 }
 
-bool postfix(const std::string& path, const std::string& type) {
-    if(path.length() >= type.length())
-        return path.compare(path.length() - type.length(), type.length(), type) == 0;
-    return false;
-}
-
 bool Widget_Render::UI(Scene& scene, Widget_Camera& cam, Camera& user_cam, std::string& err) {
 
     bool ret = false;
@@ -773,8 +794,13 @@ bool Widget_Render::UI(Scene& scene, Widget_Camera& cam, Camera& user_cam, std::
             if(method == 1) {
                 has_rendered = true;
                 ret = true;
-                ray_log.clear();
+                clear_log();
                 pathtracer.set_sizes(out_w, out_h, out_samples, out_area_samples, out_depth);
+                pathtracer.set_roulette((PT::Roulette_Policy)out_roulette,
+                                        (size_t)out_roulette_depth);
+                pathtracer.set_mis((PT::MIS_Mode)out_mis);
+                pathtracer.set_guiding(out_guiding);
+                pathtracer.set_denoise(out_denoise);
                 pathtracer.begin_render(scene, cam.get());
             } else {
                 Renderer::get().save(scene, cam.get(), out_w, out_h, out_samples);
@@ -785,27 +811,26 @@ bool Widget_Render::UI(Scene& scene, Widget_Camera& cam, Camera& user_cam, std::
     ImGui::SameLine();
     if(ImGui::Button("Save Image")) {
         char* path = nullptr;
-        NFD_SaveDialog("png", nullptr, &path);
+        NFD_SaveDialog(method == 1 ? "png,exr,pfm" : "png", nullptr, &path);
         if(path) {
 
             std::string spath(path);
-            if(!postfix(spath, ".png")) {
+            bool is_float = method == 1 && (postfix(spath, ".exr") || postfix(spath, ".pfm"));
+            if(!is_float && !postfix(spath, ".png")) {
                 spath += ".png";
             }
 
-            std::vector<unsigned char> data;
-
             if(method == 1) {
-                pathtracer.get_output().tonemap_to(data, exposure);
-                stbi_flip_vertically_on_write(false);
+                std::string save_err = save_image(pathtracer.get_output(), spath, exposure);
+                if(!save_err.empty()) err = save_err;
             } else {
+                std::vector<unsigned char> data;
                 Renderer::get().saved(data);
                 stbi_flip_vertically_on_write(true);
-            }
-
-            if(!stbi_write_png(spath.c_str(), (int)out_w, (int)out_h, 4, data.data(),
-                               (int)out_w * 4)) {
-                err = "Failed to write png!";
+                if(!stbi_write_png(spath.c_str(), (int)out_w, (int)out_h, 4, data.data(),
+                                   (int)out_w * 4)) {
+                    err = "Failed to write png!";
+                }
             }
             free(path);
         }
@@ -829,6 +854,7 @@ bool Widget_Render::UI(Scene& scene, Widget_Camera& cam, Camera& user_cam, std::
         if(!pathtracer.in_progress() && has_rendered) {
             auto [build, render] = pathtracer.completion_time();
             ImGui::Text("Scene built in %.2fs, rendered in %.2fs.", build, render);
+            stats_UI(pathtracer.stats());
         }
     } else {
         ImGui::Image((ImTextureID)(long long)Renderer::get().saved(), {w, h}, {0.0f, 1.0f},
@@ -839,9 +865,53 @@ bool Widget_Render::UI(Scene& scene, Widget_Camera& cam, Camera& user_cam, std::
     return ret;
 }
 
+void Widget_Render::stats_UI(const PT::Ray_Stats& stats) {
+
+    if(!ImGui::CollapsingHeader("Statistics")) return;
+
+    ImGui::Text("Tracing: %.2fs, accumulating: %.2fs (summed over threads)", stats.trace_time,
+                stats.accumulate_time);
+    ImGui::Text("Rays: %zu camera, %zu shadow, %zu bounce", stats.camera_rays, stats.shadow_rays,
+                stats.bounce_rays);
+    if(stats.trace_time > 0.0) {
+        ImGui::Text("%.2f million rays per thread-second", stats.rays() / stats.trace_time / 1e6);
+    }
+    if(!PT::Ray_Stats::enabled) {
+        ImGui::Text("Build with CARDINAL3D_RAY_STATS for traversal counts.");
+        return;
+    }
+
+    size_t rays = std::max(stats.rays(), size_t(1));
+    ImGui::Text("BVH: %.1f nodes and %.1f primitives per ray",
+                (double)stats.nodes_visited / rays, (double)stats.primitive_tests / rays);
+    ImGui::Text("Roulette terminations: %zu", stats.roulette_kills);
+
+    float lengths[PT::Ray_Stats::path_bins];
+    int n = 0;
+    for(size_t i = 0; i < PT::Ray_Stats::path_bins; i++) {
+        lengths[i] = (float)stats.path_lengths[i];
+        if(stats.path_lengths[i]) n = (int)i + 1;
+    }
+    ImGui::PlotHistogram("Path depths", lengths, n, 0, nullptr, 0.0f, FLT_MAX, {0.0f, 60.0f});
+}
+
+void Widget_Render::push_frame(const std::string& path) {
+    Frame_Writer::Frame frame;
+    frame.path = path;
+    headless_stats.merge(pathtracer.stats());
+    frame.image = pathtracer.take_output();
+    frame.exposure = exposure;
+    if(pathtracer.has_aovs()) {
+        frame.aov_path = aov_path(path);
+        frame.aovs = pathtracer.take_aovs();
+    }
+    writer.push(std::move(frame));
+}
+
 std::string Widget_Render::headless(Animate& animate, Scene& scene, const Camera& cam,
                                     std::string output, bool a, int w, int h, int s, int ls, int d,
-                                    float exp) {
+                                    float exp, float budget, int pipeline_depth,
+                                    int pipeline_memory) {
 
     info("Render settings:");
     info("\twidth: %d", w);
@@ -850,11 +920,18 @@ std::string Widget_Render::headless(Animate& animate, Scene& scene, const Camera
     info("\tlight samples: %d", ls);
     info("\tmax depth: %d", d);
     info("\texposure: %f", exp);
+    if(budget > 0.0f) info("\ttime budget: %.2fs", budget);
+    if(a && pipeline_depth > 0) {
+        info("\tpipeline: %d frames, %d MB", pipeline_depth, pipeline_memory);
+    }
     info("\trender threads: %u", std::thread::hardware_concurrency());
 
     out_w = w;
     out_h = h;
+    exposure = exp;
+    headless_stats = {};
     pathtracer.set_sizes(w, h, s, ls, d);
+    pathtracer.set_time_budget(budget);
 
     auto print_progress = [](float f) {
         std::cout << "Progress: [";
@@ -874,7 +951,31 @@ std::string Widget_Render::headless(Animate& animate, Scene& scene, const Camera
     };
 
     std::cout << std::fixed << std::setw(2) << std::setprecision(2) << std::setfill('0');
-    if(a) {
+    if(a && pipeline_depth > 0) {
+
+        // Later frames are posed and built on another thread while this one traces
+        int n_frames = animate.n_frames();
+        Scene_Pipeline pipeline(animate, scene, pathtracer, n_frames, (size_t)pipeline_depth,
+                                (size_t)std::max(pipeline_memory, 0) * 1024 * 1024);
+
+        Scene_Pipeline::Frame frame;
+        while(pipeline.next(frame)) {
+            pathtracer.begin_render(std::move(frame.data), frame.cam);
+            while(!pathtracer.wait_for(std::chrono::milliseconds(250))) {
+                print_progress(((float)frame.index + pathtracer.progress()) / n_frames);
+            }
+
+            std::string err = writer.error();
+            if(!err.empty()) return err;
+            push_frame(frame_path(output, frame.index));
+        }
+        print_progress(1.0f);
+        std::cout << std::endl;
+
+        std::string err = writer.flush();
+        if(!err.empty()) return err;
+
+    } else if(a) {
 
         method = 1;
         init = true;
@@ -886,32 +987,96 @@ std::string Widget_Render::headless(Animate& animate, Scene& scene, const Camera
             std::string err = step(animate, scene);
             if(!err.empty()) return err;
             print_progress(((float)next_frame + pathtracer.progress()) / (max_frame + 1));
-            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            pathtracer.wait_for(std::chrono::milliseconds(250));
         }
         std::cout << std::endl;
 
+        std::string err = writer.flush();
+        if(!err.empty()) return err;
+
     } else {
 
         pathtracer.begin_render(scene, cam);
-        while(pathtracer.in_progress()) {
+        while(!pathtracer.wait_for(std::chrono::milliseconds(250))) {
             print_progress(pathtracer.progress());
-            std::this_thread::sleep_for(std::chrono::milliseconds(250));
         }
+        print_progress(1.0f);
         std::cout << std::endl;
+        headless_stats = pathtracer.stats();
 
-        std::vector<unsigned char> data;
-        pathtracer.get_output().tonemap_to(data, exp);
-        if(!stbi_write_png(output.c_str(), w, h, 4, data.data(), w * 4)) {
-            return "Failed to write output!";
+        std::string err = save_image(pathtracer.get_output(), output, exp);
+        if(!err.empty()) return err;
+        if(pathtracer.has_aovs()) {
+            err = pathtracer.get_aovs().save_exr(aov_path(output));
+            if(!err.empty()) return err;
         }
     }
 
     return {};
 }
 
-void Widget_Render::render_log(const Mat4& view) const {
-    std::lock_guard<std::mutex> lock(log_mut);
+std::string Widget_Render::benchmark_roulette(Scene& scene, const Camera& cam, int w, int h, int s,
+                                              int ls, int d, int min_depth) {
+
+    // The reference is rendered without any roulette at a higher sample count;
+    // every policy is then rendered at the requested sample count and compared to it.
+    static const int reference_scale = 8;
+
+    info("Roulette benchmark settings:");
+    info("\twidth: %d", w);
+    info("\theight: %d", h);
+    info("\tsamples: %d (reference: %d)", s, s * reference_scale);
+    info("\tlight samples: %d", ls);
+    info("\tmax depth: %d", d);
+    info("\troulette min depth: %d", min_depth);
+
+    out_w = w;
+    out_h = h;
+    pathtracer.set_time_budget(0.0f);
+
+    pathtracer.set_sizes(w, h, s * reference_scale, ls, d);
+    pathtracer.set_roulette(PT::Roulette_Policy::none, 0);
+    pathtracer.begin_render(scene, cam);
+    pathtracer.wait();
+
+    HDR_Image reference = pathtracer.get_raw_output().copy();
+    info("Rendered reference in %.2fs", pathtracer.completion_time().second);
+
+    for(int i = 0; i < (int)PT::Roulette_Policy::count; i++) {
+
+        pathtracer.set_sizes(w, h, s, ls, d);
+        pathtracer.set_roulette((PT::Roulette_Policy)i, (size_t)min_depth);
+        pathtracer.begin_render(scene, cam);
+        pathtracer.wait();
+
+        float time = pathtracer.completion_time().second;
+        float rate = (float)w * h * s / std::max(time, 1e-6f);
+        float rmse = pathtracer.get_raw_output().rmse(reference);
+
+        // Efficiency is the inverse of (error^2 * time): higher is better
+        float efficiency = 1.0f / std::max(rmse * rmse * time, 1e-12f);
+
+        info("%-10s %8.2fs %10.3f Msamples/s  RMSE %.6f  efficiency %.4g",
+             PT::Roulette_Policy_Names[i], time, rate / 1e6f, rmse, efficiency);
+    }
+
+    return {};
+}
+
+void Widget_Render::render_log(const Mat4& view) {
+    PT::Ray_Log& log = pathtracer.get_ray_log();
+    if(log.collect()) {
+        ray_log.clear();
+        for(const PT::Ray_Log::Line& line : log.lines()) {
+            ray_log.add(line.start, line.end, Vec3(line.color.r, line.color.g, line.color.b));
+        }
+    }
     Renderer::get().lines(ray_log, view);
 }
 
+void Widget_Render::clear_log() {
+    pathtracer.get_ray_log().clear();
+    ray_log.clear();
+}
+
 } // namespace Gui
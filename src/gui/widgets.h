@@ -5,6 +5,9 @@
 #include "../rays/pathtracer.h"
 #include "../scene/scene.h"
 
+#include "frame_writer.h"
+#include "scene_pipeline.h"
+
 class Undo;
 
 namespace Gui {
@@ -84,10 +87,13 @@ public:
     std::string step(Animate& animate, Scene& scene);
 
     std::string headless(Animate& animate, Scene& scene, const Camera& cam, std::string output,
-                         bool a, int w, int h, int s, int ls, int d, float exp);
+                         bool a, int w, int h, int s, int ls, int d, float exp,
+                         float budget = 0.0f, int pipeline_depth = 0, int pipeline_memory = 0);
+    std::string benchmark_roulette(Scene& scene, const Camera& cam, int w, int h, int s, int ls,
+                                   int d, int min_depth);
 
-    void log_ray(const Ray& ray, float t, Spectrum color = Spectrum{1.0f});
-    void render_log(const Mat4& view) const;
+    void render_log(const Mat4& view);
+    void clear_log();
 
     PT::Pathtracer& tracer() {
         return pathtracer;
@@ -98,6 +104,10 @@ public:
     std::pair<float, float> completion_time() const {
         return pathtracer.completion_time();
     }
+    /// Statistics of the last headless render, summed over its frames
+    const PT::Ray_Stats& stats() const {
+        return headless_stats;
+    }
     bool in_progress() const {
         return pathtracer.in_progress();
     }
@@ -107,11 +117,18 @@ public:
 
 private:
     void begin(Scene& scene, Widget_Camera& cam, Camera& user_cam);
+    void push_frame(const std::string& path);
+    void stats_UI(const PT::Ray_Stats& stats);
 
-    mutable std::mutex log_mut;
+    // Rebuilt from the tracer's log when it has new rays
     GL::Lines ray_log;
 
+    Frame_Writer writer;
+
     int out_w, out_h, out_samples = 32, out_area_samples = 8, out_depth = 4;
+    int out_roulette = (int)PT::Roulette_Policy::throughput, out_roulette_depth = 2;
+    int out_mis = (int)PT::MIS_Mode::none;
+    bool out_guiding = false, out_denoise = false;
     float exposure = 1.0f;
 
     bool has_rendered = false;
@@ -123,6 +140,7 @@ private:
 
     char output_path[256] = {};
     std::string folder;
+    PT::Ray_Stats headless_stats;
 
     GL::MSAA msaa;
     PT::Pathtracer pathtracer;
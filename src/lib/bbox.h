@@ -80,6 +80,38 @@ struct BBox {
     // TODO (PathTracer): see student/bbox.cpp
     bool hit(const Ray& ray, Vec2& times) const;
 
+    /// Clip times, the range of distances to consider, to the part of the ray
+    /// inside the box, and return whether anything is left. Branch-free: a
+    /// distance that comes out NaN (the ray lies in a slab's plane) is ignored.
+    bool hit(const Ray_Box& ray, Vec2& times) const {
+#ifdef CARDINAL3D_SSE
+        __m128 lo = _mm_setr_ps(min.x, min.y, min.z, 0.0f);
+        __m128 hi = _mm_setr_ps(max.x, max.y, max.z, 0.0f);
+        __m128 enter = _mm_or_ps(_mm_and_ps(ray.neg4, hi), _mm_andnot_ps(ray.neg4, lo));
+        __m128 leave = _mm_or_ps(_mm_and_ps(ray.neg4, lo), _mm_andnot_ps(ray.neg4, hi));
+        enter = _mm_mul_ps(_mm_sub_ps(enter, ray.o4), ray.inv4);
+        leave = _mm_mul_ps(_mm_sub_ps(leave, ray.o4), ray.inv4);
+
+        // max/min return their second operand when either is NaN
+        __m128 t0 = _mm_max_ps(enter, _mm_set1_ps(times.x));
+        __m128 t1 = _mm_min_ps(leave, _mm_set1_ps(times.y));
+        t0 = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(2, 3, 0, 1)));
+        t0 = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(1, 0, 3, 2)));
+        t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(2, 3, 0, 1)));
+        t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(1, 0, 3, 2)));
+        times.x = _mm_cvtss_f32(t0);
+        times.y = _mm_cvtss_f32(t1);
+#else
+        for(int i = 0; i < 3; i++) {
+            float enter = ((ray.neg[i] ? max[i] : min[i]) - ray.point[i]) * ray.inv_dir[i];
+            float leave = ((ray.neg[i] ? min[i] : max[i]) - ray.point[i]) * ray.inv_dir[i];
+            times.x = enter > times.x ? enter : times.x;
+            times.y = leave < times.y ? leave : times.y;
+        }
+#endif
+        return times.x <= times.y;
+    }
+
     /// Get the eight corner points of the bounding box
     std::vector<Vec3> corners() const {
         std::vector<Vec3> ret(8);
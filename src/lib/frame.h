@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cmath>
+
+#include "vec3.h"
+
+// Orthonormal basis. Shading happens in a local space where the surface normal
+// is +Y, matching Mat4::rotate_to, but a frame holds only the three axes and
+// maps vectors with dot products instead of 4x4 matrix math.
+struct Frame {
+
+    Frame() : x(1.0f, 0.0f, 0.0f), y(0.0f, 1.0f, 0.0f), z(0.0f, 0.0f, 1.0f) {
+    }
+    explicit Frame(Vec3 x, Vec3 y, Vec3 z) : x(x), y(y), z(z) {
+    }
+
+    /// Right-handed frame whose Y axis is the unit vector n, built without branches
+    /// (Duff et al., "Building an Orthonormal Basis, Revisited", 2017)
+    static Frame from_y(Vec3 n) {
+        float sign = std::copysign(1.0f, n.z);
+        float a = -1.0f / (sign + n.z);
+        float b = n.x * n.y * a;
+        Vec3 t(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+        Vec3 s(b, sign + n.y * n.y * a, -n.y);
+        return Frame(s, n, t);
+    }
+
+    Vec3 to_local(Vec3 v) const {
+        return Vec3(dot(v, x), dot(v, y), dot(v, z));
+    }
+    Vec3 to_world(Vec3 v) const {
+        return x * v.x + y * v.y + z * v.z;
+    }
+
+    Vec3 x, y, z;
+};
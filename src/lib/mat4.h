@@ -6,8 +6,14 @@
 #include <ostream>
 
 #include "log.h"
+#include "simd.h"
 #include "vec4.h"
 
+#ifdef CARDINAL3D_SSE
+// Lanes a, b, c, d of v
+#define MAT4_SWIZZLE(v, a, b, c, d) _mm_shuffle_ps(v, v, _MM_SHUFFLE(d, c, b, a))
+#endif
+
 struct Mat4 {
 
     /// Identity matrix
@@ -135,6 +141,9 @@ struct Mat4 {
     }
     Mat4 operator*(const Mat4& m) const {
         Mat4 ret;
+#ifdef CARDINAL3D_SSE
+        for(int i = 0; i < 4; i++) ret.cols[i] = operator*(m.cols[i]);
+#else
         for(int i = 0; i < 4; i++) {
             for(int j = 0; j < 4; j++) {
                 ret[i][j] = 0.0f;
@@ -143,11 +152,21 @@ struct Mat4 {
                 }
             }
         }
+#endif
         return ret;
     }
 
     Vec4 operator*(Vec4 v) const {
+#ifdef CARDINAL3D_SSE
+        __m128 p = v.m128();
+        __m128 r = _mm_mul_ps(cols[0].m128(), MAT4_SWIZZLE(p, 0, 0, 0, 0));
+        r = _mm_add_ps(r, _mm_mul_ps(cols[1].m128(), MAT4_SWIZZLE(p, 1, 1, 1, 1)));
+        r = _mm_add_ps(r, _mm_mul_ps(cols[2].m128(), MAT4_SWIZZLE(p, 2, 2, 2, 2)));
+        r = _mm_add_ps(r, _mm_mul_ps(cols[3].m128(), MAT4_SWIZZLE(p, 3, 3, 3, 3)));
+        return Vec4(r);
+#else
         return v[0] * cols[0] + v[1] * cols[1] + v[2] * cols[2] + v[3] * cols[3];
+#endif
     }
 
     /// Expands v to Vec4(v, 1.0), multiplies, and projects back to 3D
@@ -285,16 +304,88 @@ inline Mat4 outer(Vec4 u, Vec4 v) {
 
 inline Mat4 Mat4::transpose(const Mat4& m) {
     Mat4 r;
+#ifdef CARDINAL3D_SSE
+    __m128 c0 = m.cols[0].m128(), c1 = m.cols[1].m128();
+    __m128 c2 = m.cols[2].m128(), c3 = m.cols[3].m128();
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    r.cols[0] = Vec4(c0);
+    r.cols[1] = Vec4(c1);
+    r.cols[2] = Vec4(c2);
+    r.cols[3] = Vec4(c3);
+#else
     for(int i = 0; i < 4; i++) {
         for(int j = 0; j < 4; j++) {
             r[i][j] = m[j][i];
         }
     }
+#endif
     return r;
 }
 
+#ifdef CARDINAL3D_SSE
+// 2x2 matrices packed as (m00, m01, m10, m11), for the block inverse below
+// a * b
+inline __m128 mat2_mul(__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, MAT4_SWIZZLE(b, 0, 3, 0, 3)),
+                      _mm_mul_ps(MAT4_SWIZZLE(a, 1, 0, 3, 2), MAT4_SWIZZLE(b, 2, 1, 2, 1)));
+}
+// adj(a) * b
+inline __m128 mat2_adj_mul(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(MAT4_SWIZZLE(a, 3, 3, 0, 0), b),
+                      _mm_mul_ps(MAT4_SWIZZLE(a, 1, 1, 2, 2), MAT4_SWIZZLE(b, 2, 3, 0, 1)));
+}
+// a * adj(b)
+inline __m128 mat2_mul_adj(__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, MAT4_SWIZZLE(b, 3, 0, 3, 0)),
+                      _mm_mul_ps(MAT4_SWIZZLE(a, 1, 0, 3, 2), MAT4_SWIZZLE(b, 2, 1, 2, 1)));
+}
+#endif
+
 inline Mat4 Mat4::inverse(const Mat4& m) {
     Mat4 r;
+#ifdef CARDINAL3D_SSE
+    // Inverts [A B; C D] from the adjugates of its 2x2 blocks. This inverts the
+    // transpose when the columns are read as rows, which gives the inverse's columns.
+    __m128 c0 = m.cols[0].m128(), c1 = m.cols[1].m128();
+    __m128 c2 = m.cols[2].m128(), c3 = m.cols[3].m128();
+
+    __m128 A = _mm_movelh_ps(c0, c1), B = _mm_movehl_ps(c1, c0);
+    __m128 C = _mm_movelh_ps(c2, c3), D = _mm_movehl_ps(c3, c2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 dets = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(2, 0, 2, 0)),
+                                        _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(3, 1, 3, 1))),
+                             _mm_mul_ps(_mm_shuffle_ps(c0, c2, _MM_SHUFFLE(3, 1, 3, 1)),
+                                        _mm_shuffle_ps(c1, c3, _MM_SHUFFLE(2, 0, 2, 0))));
+    __m128 det_A = MAT4_SWIZZLE(dets, 0, 0, 0, 0), det_B = MAT4_SWIZZLE(dets, 1, 1, 1, 1);
+    __m128 det_C = MAT4_SWIZZLE(dets, 2, 2, 2, 2), det_D = MAT4_SWIZZLE(dets, 3, 3, 3, 3);
+
+    __m128 D_C = mat2_adj_mul(D, C);
+    __m128 A_B = mat2_adj_mul(A, B);
+    __m128 X = _mm_sub_ps(_mm_mul_ps(det_D, A), mat2_mul(B, D_C));
+    __m128 W = _mm_sub_ps(_mm_mul_ps(det_A, D), mat2_mul(C, A_B));
+    __m128 Y = _mm_sub_ps(_mm_mul_ps(det_B, C), mat2_mul_adj(D, A_B));
+    __m128 Z = _mm_sub_ps(_mm_mul_ps(det_C, B), mat2_mul_adj(A, D_C));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    __m128 tr = _mm_mul_ps(A_B, MAT4_SWIZZLE(D_C, 0, 2, 1, 3));
+    tr = _mm_add_ps(tr, _mm_movehl_ps(tr, tr));
+    tr = _mm_add_ss(tr, MAT4_SWIZZLE(tr, 1, 1, 1, 1));
+    __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_A, det_D), _mm_mul_ps(det_B, det_C)),
+                            MAT4_SWIZZLE(tr, 0, 0, 0, 0));
+
+    __m128 scale = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+    X = _mm_mul_ps(X, scale);
+    Y = _mm_mul_ps(Y, scale);
+    Z = _mm_mul_ps(Z, scale);
+    W = _mm_mul_ps(W, scale);
+
+    r.cols[0] = Vec4(_mm_shuffle_ps(X, Y, _MM_SHUFFLE(1, 3, 1, 3)));
+    r.cols[1] = Vec4(_mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 2, 0, 2)));
+    r.cols[2] = Vec4(_mm_shuffle_ps(Z, W, _MM_SHUFFLE(1, 3, 1, 3)));
+    r.cols[3] = Vec4(_mm_shuffle_ps(Z, W, _MM_SHUFFLE(0, 2, 0, 2)));
+    return r;
+#else
     r[0][0] = m[1][2] * m[2][3] * m[3][1] - m[1][3] * m[2][2] * m[3][1] +
               m[1][3] * m[2][1] * m[3][2] - m[1][1] * m[2][3] * m[3][2] -
               m[1][2] * m[2][1] * m[3][3] + m[1][1] * m[2][2] * m[3][3];
@@ -345,6 +436,7 @@ inline Mat4 Mat4::inverse(const Mat4& m) {
               m[0][1] * m[1][0] * m[2][2] + m[0][0] * m[1][1] * m[2][2];
     r /= m.det();
     return r;
+#endif
 }
 
 inline Mat4 Mat4::rotate_to(Vec3 dir) {
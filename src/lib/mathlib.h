@@ -50,6 +50,7 @@ inline float smoothstep(float e0, float e1, float x) {
 }
 
 #include "bbox.h"
+#include "frame.h"
 #include "mat4.h"
 #include "quat.h"
 #include "ray.h"
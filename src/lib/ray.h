@@ -6,8 +6,11 @@
 #include <ostream>
 
 #include "../lib/mathlib.h"
-#include "../lib/spectrum.h"
+#include "../lib/simd.h"
 
+// What traversal needs to know about a ray, and nothing more, so that it stays
+// cheap to pass around and to copy into instance space. The state of the path a
+// ray belongs to is kept by the integrator (see PT::Path).
 struct Ray {
 
     Ray() = default;
@@ -39,20 +42,38 @@ struct Ray {
     Vec3 point;
     /// The direction the ray travels in
     Vec3 dir;
-    /// Total attenuation new light will be scaled by to get to the source of this ray
-    Spectrum beta = Spectrum(1.0f);
-    /// Recursive depth of ray
-    size_t depth = 0;
-    
-    Spectrum Lo = Spectrum(0.0f);
-    Spectrum rcolor = Spectrum(0.0f);
-    Spectrum DoE = Spectrum(0.0f);
 
     /// The minimum and maximum distance at which this ray can encounter collisions
     /// note that this field is mutable, meaning it can be changed on const Rays
     mutable Vec2 dist_bounds = Vec2(0.0f, std::numeric_limits<float>::infinity());
 };
 
+static_assert(sizeof(Ray) == 32, "Ray should only hold what traversal needs");
+
+/// A ray prepared for BVH traversal: the reciprocal of its direction and which
+/// components are negative are computed once per ray instead of once per box.
+struct Ray_Box {
+
+    explicit Ray_Box(const Ray& ray) : point(ray.point) {
+        for(int i = 0; i < 3; i++) {
+            inv_dir[i] = 1.0f / ray.dir[i];
+            neg[i] = std::signbit(inv_dir[i]);
+        }
+#ifdef CARDINAL3D_SSE
+        // The padding lane yields NaN distances, which BBox::hit ignores
+        o4 = _mm_setr_ps(point.x, point.y, point.z, 0.0f);
+        inv4 = _mm_setr_ps(inv_dir.x, inv_dir.y, inv_dir.z, std::numeric_limits<float>::quiet_NaN());
+        neg4 = _mm_castsi128_ps(_mm_setr_epi32(-neg[0], -neg[1], -neg[2], 0));
+#endif
+    }
+
+    Vec3 point, inv_dir;
+    int neg[3];
+#ifdef CARDINAL3D_SSE
+    __m128 o4, inv4, neg4;
+#endif
+};
+
 inline std::ostream& operator<<(std::ostream& out, Ray r) {
     out << "Ray{" << r.point << "," << r.dir << "}";
     return out;
@@ -0,0 +1,16 @@
+#pragma once
+
+// The math types and ray tests use SSE where it is available, unless
+// CARDINAL3D_NO_SIMD is defined (see CMakeLists.txt). The scalar code is kept
+// alongside as the reference and for other targets.
+#if(defined(__SSE2__) || defined(_M_X64)) && !defined(CARDINAL3D_NO_SIMD)
+#define CARDINAL3D_SSE
+#include <emmintrin.h>
+#endif
+
+// Types loaded as one SSE register are 16-byte aligned
+#ifdef CARDINAL3D_SSE
+#define CARDINAL3D_ALIGN16 alignas(16)
+#else
+#define CARDINAL3D_ALIGN16
+#endif
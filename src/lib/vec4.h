@@ -6,6 +6,7 @@
 #include <ostream>
 
 #include "log.h"
+#include "simd.h"
 #include "vec3.h"
 
 struct Vec4 {
@@ -37,6 +38,14 @@ struct Vec4 {
         z = xyz.z;
         w = _w;
     }
+#ifdef CARDINAL3D_SSE
+    explicit Vec4(__m128 v) {
+        _mm_store_ps(data, v);
+    }
+    __m128 m128() const {
+        return _mm_load_ps(data);
+    }
+#endif
 
     Vec4(const Vec4&) = default;
     Vec4& operator=(const Vec4&) = default;
@@ -109,6 +118,20 @@ struct Vec4 {
         return *this;
     }
 
+#ifdef CARDINAL3D_SSE
+    Vec4 operator+(Vec4 v) const {
+        return Vec4(_mm_add_ps(m128(), v.m128()));
+    }
+    Vec4 operator-(Vec4 v) const {
+        return Vec4(_mm_sub_ps(m128(), v.m128()));
+    }
+    Vec4 operator*(Vec4 v) const {
+        return Vec4(_mm_mul_ps(m128(), v.m128()));
+    }
+    Vec4 operator/(Vec4 v) const {
+        return Vec4(_mm_div_ps(m128(), v.m128()));
+    }
+#else
     Vec4 operator+(Vec4 v) const {
         return Vec4(x + v.x, y + v.y, z + v.z, w + v.w);
     }
@@ -121,6 +144,7 @@ struct Vec4 {
     Vec4 operator/(Vec4 v) const {
         return Vec4(x / v.x, y / v.y, z / v.z, w / v.w);
     }
+#endif
 
     Vec4 operator+(float s) const {
         return Vec4(x + s, y + s, z + s, w + s);
@@ -129,7 +153,11 @@ struct Vec4 {
         return Vec4(x - s, y - s, z - s, w - s);
     }
     Vec4 operator*(float s) const {
+#ifdef CARDINAL3D_SSE
+        return Vec4(_mm_mul_ps(m128(), _mm_set1_ps(s)));
+#else
         return Vec4(x * s, y * s, z * s, w * s);
+#endif
     }
     Vec4 operator/(float s) const {
         return Vec4(x / s, y / s, z / s, w / s);
@@ -194,7 +222,7 @@ struct Vec4 {
             float z;
             float w;
         };
-        float data[4] = {};
+        CARDINAL3D_ALIGN16 float data[4] = {};
     };
 };
 
@@ -1,6 +1,8 @@
 
 #include "platform/platform.h"
+#include "util/profiler.h"
 #include "util/rand.h"
+#include "util/thread_pool.h"
 #include <sf_libs/CLI11.hpp>
 
 int main(int argc, char** argv) {
@@ -13,7 +15,8 @@ int main(int argc, char** argv) {
     args.add_option("-s,--scene", settings.scene_file, "Scene file to load");
     args.add_option("--env_map", settings.env_map_file, "Override scene environment map");
     args.add_flag("--headless", settings.headless, "Path-trace scene without opening the GUI");
-    args.add_option("-o,--output", settings.output_file, "Image file to write (if headless)");
+    args.add_option("-o,--output", settings.output_file,
+                    "Image file to write; .exr and .pfm keep float radiance (if headless)");
     args.add_flag("--animate", settings.animate, "Output animation frames (if headless)");
     args.add_option("--width", settings.w, "Output image width (if headless)");
     args.add_option("--height", settings.h, "Output image height (if headless)");
@@ -23,8 +26,85 @@ int main(int argc, char** argv) {
     args.add_option("--samples", settings.s, "Pixel samples (if headless)");
     args.add_option("--exposure", settings.exp, "Output exposure (if headless)");
     args.add_option("--area_samples", settings.ls, "Area light samples (if headless)");
+    args.add_option("--time_budget", settings.time_budget,
+                    "Render progressive passes for this many seconds instead of a fixed sample "
+                    "count (if headless)");
+
+
+    std::map<std::string, PT::Roulette_Policy> roulette_policies{
+        {"none", PT::Roulette_Policy::none},
+        {"fixed", PT::Roulette_Policy::fixed},
+        {"throughput", PT::Roulette_Policy::throughput},
+        {"splitting", PT::Roulette_Policy::splitting}};
+    args.add_option("--roulette", settings.roulette, "Path termination policy (if headless)")
+        ->transform(CLI::CheckedTransformer(roulette_policies, CLI::ignore_case));
+    args.add_option("--roulette_depth", settings.roulette_depth,
+                    "Path depth at which roulette starts (if headless)");
+    args.add_flag("--roulette_benchmark", settings.roulette_benchmark,
+                  "Compare speed and error of each roulette policy instead of rendering");
+    args.add_flag("--parallel_benchmark", settings.parallel_benchmark,
+                  "Measure how parallel loops scale with thread count instead of rendering");
+    args.add_flag("--render_benchmark", settings.render_benchmark,
+                  "Render the benchmark corpus and compare each scene to its reference instead "
+                  "of rendering");
+    args.add_option("--bench_scenes", settings.bench_scenes,
+                    "Comma-separated scene files to render before the generated scenes, in "
+                    "place of media/model.dae (if render_benchmark)")
+        ->delimiter(',');
+    args.add_option("--bench_add_scenes", settings.bench_add_scenes,
+                    "Comma-separated scene files to render after media/model.dae or the "
+                    "bench_scenes (if render_benchmark)")
+        ->delimiter(',');
+    args.add_option("--bench_references", settings.bench_references,
+                    "Directory of reference renders; missing ones are rendered and written "
+                    "(if render_benchmark)");
+    args.add_option("--seed", settings.seed,
+                    "Seed every render with this so it repeats exactly; 0 seeds randomly, and "
+                    "the render benchmark uses 1 (if headless)");
+
+    std::map<std::string, PT::MIS_Mode> mis_modes{{"none", PT::MIS_Mode::none},
+                                                  {"balance", PT::MIS_Mode::balance},
+                                                  {"power", PT::MIS_Mode::power}};
+    args.add_option("--mis", settings.mis,
+                    "Combine light and BSDF sampling with this heuristic (if headless)")
+        ->transform(CLI::CheckedTransformer(mis_modes, CLI::ignore_case));
+    args.add_flag("--guiding", settings.guiding,
+                  "Learn where light arrives from and guide sampling with it (if headless)");
+    args.add_flag("--denoise", settings.denoise,
+                  "Filter the finished render using albedo and normal buffers (if headless)");
+
+    std::map<std::string, PT::AOV> aovs{
+        {"depth", PT::AOV::depth},       {"normal", PT::AOV::normal},
+        {"albedo", PT::AOV::albedo},     {"material", PT::AOV::material},
+        {"object", PT::AOV::object},     {"samples", PT::AOV::samples},
+        {"time", PT::AOV::time}};
+    args.add_option("--aov", settings.aovs,
+                    "Comma-separated AOVs to write to <output>.aovs.exr (if headless)")
+        ->delimiter(',')
+        ->transform(CLI::CheckedTransformer(aovs, CLI::ignore_case));
+
+    args.add_option("--pipeline_depth", settings.pipeline_depth,
+                    "Animation frames to prepare while the current one traces; 0 prepares "
+                    "each frame after the last finishes (if headless)");
+    args.add_option("--pipeline_memory", settings.pipeline_memory,
+                    "Megabytes of prepared animation frames to keep ahead (if headless)");
+
+    args.add_flag("--pin_threads", settings.pin_threads,
+                  "Pin worker threads to CPUs, spread over NUMA nodes (Linux only)");
+    args.add_option("--stats", settings.stats_file,
+                    "Write ray counts and the time spent building, tracing and accumulating to "
+                    "this JSON file, or the render benchmark's report (if headless)");
+    args.add_option("--profile", settings.profile_file,
+                    "Record where each thread spends its time and write it to this Chrome trace "
+                    "JSON file on exit");
 
     CLI11_PARSE(args, argc, argv);
+    Thread_Pool::pin_shared(settings.pin_threads);
+
+    if(!settings.profile_file.empty()) {
+        Profiler::enable(true);
+        Profiler::name_thread("Main");
+    }
 
     if(!settings.headless) {
         Platform plt;
@@ -33,5 +113,10 @@ int main(int argc, char** argv) {
     } else {
         App app(settings);
     }
+
+    if(!settings.profile_file.empty()) {
+        std::string err = Profiler::write(settings.profile_file);
+        if(!err.empty()) warn("Error writing profile: %s", err.c_str());
+    }
     return 0;
 }
@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cstring>
+
+#include "aov.h"
+#include "../util/exr.h"
+
+namespace PT {
+
+const char* AOV_Names[(int)AOV::count] = {"Depth",  "Normal",  "Albedo", "Material",
+                                          "Object", "Samples", "Time"};
+
+// Channel names used in EXR output
+static const char* AOV_Channels[(int)AOV::count][3] = {{"depth.Z"},
+                                                      {"normal.X", "normal.Y", "normal.Z"},
+                                                      {"albedo.R", "albedo.G", "albedo.B"},
+                                                      {"material.id"},
+                                                      {"object.id"},
+                                                      {"samples.count"},
+                                                      {"time.seconds"}};
+
+size_t AOV_Buffers::channels(AOV aov) {
+    return aov == AOV::normal || aov == AOV::albedo ? 3 : 1;
+}
+
+void AOV_Buffers::enable(AOV aov, bool value) {
+    on[(int)aov] = value;
+    resize(w, h);
+}
+
+bool AOV_Buffers::any() const {
+    for(int i = 0; i < (int)AOV::count; i++) {
+        if(on[i]) return true;
+    }
+    return false;
+}
+
+void AOV_Buffers::resize(size_t _w, size_t _h) {
+    w = _w;
+    h = _h;
+    for(int i = 0; i < (int)AOV::count; i++) {
+        for(size_t c = 0; c < 3; c++) {
+            std::vector<float>& p = planes[i][c];
+            if(on[i] && c < channels((AOV)i)) {
+                p.resize(w * h);
+            } else {
+                p.clear();
+                p.shrink_to_fit();
+            }
+        }
+    }
+    clear();
+}
+
+void AOV_Buffers::clear() {
+    for(int i = 0; i < (int)AOV::count; i++) {
+        float value = 0.0f;
+        if(i == (int)AOV::depth) value = INFINITY;
+        if(i == (int)AOV::material) value = -1.0f;
+        for(size_t c = 0; c < 3; c++) {
+            std::fill(planes[i][c].begin(), planes[i][c].end(), value);
+        }
+    }
+}
+
+void AOV_Buffers::add_sample(size_t i, const AOV_Sample& sample, size_t n) {
+
+    float k = 1.0f / (n + 1);
+    if(on[(int)AOV::depth] && sample.hit) {
+        float& d = planes[(int)AOV::depth][0][i];
+        d = std::min(d, sample.depth);
+    }
+    if(on[(int)AOV::normal]) {
+        for(int c = 0; c < 3; c++) {
+            float& v = planes[(int)AOV::normal][c][i];
+            v += (sample.normal[c] - v) * k;
+        }
+    }
+    if(on[(int)AOV::albedo]) {
+        for(int c = 0; c < 3; c++) {
+            float& v = planes[(int)AOV::albedo][c][i];
+            v += (sample.albedo.data[c] - v) * k;
+        }
+    }
+    if(n == 0) {
+        if(on[(int)AOV::material]) planes[(int)AOV::material][0][i] = (float)sample.material;
+        if(on[(int)AOV::object]) planes[(int)AOV::object][0][i] = (float)sample.object;
+    }
+    if(on[(int)AOV::samples]) planes[(int)AOV::samples][0][i] += 1.0f;
+}
+
+void AOV_Buffers::add_time(size_t i, float seconds) {
+    if(on[(int)AOV::time]) planes[(int)AOV::time][0][i] += seconds;
+}
+
+void AOV_Buffers::accumulate(const AOV_Buffers& epoch, float weight) {
+
+    if(epoch.dimension() != dimension()) return;
+
+    float k = weight;
+    for(int a = 0; a < (int)AOV::count; a++) {
+        if(!on[a] || !epoch.on[a]) continue;
+        for(size_t c = 0; c < channels((AOV)a); c++) {
+
+            std::vector<float>& dst = planes[a][c];
+            const std::vector<float>& src = epoch.planes[a][c];
+
+            switch((AOV)a) {
+            case AOV::depth: {
+                for(size_t i = 0; i < w * h; i++) dst[i] = std::min(dst[i], src[i]);
+            } break;
+            case AOV::normal:
+            case AOV::albedo: {
+                for(size_t i = 0; i < w * h; i++) dst[i] += (src[i] - dst[i]) * k;
+            } break;
+            case AOV::material: {
+                for(size_t i = 0; i < w * h; i++) {
+                    if(dst[i] < 0.0f) dst[i] = src[i];
+                }
+            } break;
+            case AOV::object: {
+                for(size_t i = 0; i < w * h; i++) {
+                    if(dst[i] == 0.0f) dst[i] = src[i];
+                }
+            } break;
+            default: {
+                for(size_t i = 0; i < w * h; i++) dst[i] += src[i];
+            } break;
+            }
+        }
+    }
+}
+
+HDR_Image AOV_Buffers::image(AOV aov) const {
+
+    if(!on[(int)aov] || !w || !h) return {};
+
+    HDR_Image ret(w, h);
+    size_t n = channels(aov);
+    for(size_t i = 0; i < w * h; i++) {
+        Spectrum& s = ret.at(i);
+        for(size_t c = 0; c < 3; c++) {
+            s.data[c] = planes[(int)aov][n == 3 ? c : 0][i];
+        }
+    }
+    return ret;
+}
+
+std::string AOV_Buffers::save_exr(std::string path) const {
+
+    if(!any() || !w || !h) return "No AOVs to write!";
+
+    // EXR readers expect channels sorted by name
+    std::vector<std::pair<std::string, const float*>> layers;
+    for(int a = 0; a < (int)AOV::count; a++) {
+        if(!on[a]) continue;
+        for(size_t c = 0; c < channels((AOV)a); c++) {
+            layers.push_back({AOV_Channels[a][c], planes[a][c].data()});
+        }
+    }
+    std::sort(layers.begin(), layers.end());
+
+    std::vector<std::string> names;
+    for(const auto& layer : layers) names.push_back(layer.first);
+
+    // Planes store rows bottom to top, like HDR_Image, while EXR scanlines run top to bottom
+    return EXR::write(path, w, h, names, [&](size_t y, size_t c, float* row) {
+        std::memcpy(row, layers[c].second + (h - y - 1) * w, w * sizeof(float));
+    });
+}
+
+} // namespace PT
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../lib/mathlib.h"
+#include "../util/hdr_image.h"
+
+namespace PT {
+
+// Arbitrary output variables written next to the beauty image
+enum class AOV : int { depth, normal, albedo, material, object, samples, time, count };
+extern const char* AOV_Names[(int)AOV::count];
+
+// First-hit data for a single camera sample
+struct AOV_Sample {
+    bool hit = false;
+    float depth = 0.0f;
+    Vec3 normal;
+    Spectrum albedo;
+    int material = -1;
+    unsigned int object = 0;
+};
+
+// One planar float buffer per channel of each enabled AOV; disabled AOVs
+// take no memory. Depth keeps the nearest hit, normal and albedo are averaged,
+// material and object ids are taken from the first sample, and sample count
+// and time are totals.
+class AOV_Buffers {
+public:
+    static size_t channels(AOV aov);
+
+    void enable(AOV aov, bool value);
+    bool enabled(AOV aov) const {
+        return on[(int)aov];
+    }
+    bool any() const;
+
+    void resize(size_t w, size_t h);
+    void clear();
+    std::pair<size_t, size_t> dimension() const {
+        return {w, h};
+    }
+
+    float* plane(AOV aov, size_t channel) {
+        return planes[(int)aov][channel].data();
+    }
+    const float* plane(AOV aov, size_t channel) const {
+        return planes[(int)aov][channel].data();
+    }
+
+    /// Fold the first-hit data of one sample into pixel i
+    void add_sample(size_t i, const AOV_Sample& sample, size_t n);
+    /// Set the time spent on pixel i
+    void add_time(size_t i, float seconds);
+    /// Fold in buffers averaged over other samples; weight is the share of all
+    /// samples accumulated here, including these, that came from epoch
+    void accumulate(const AOV_Buffers& epoch, float weight);
+
+    /// Copy an AOV into an image (1-channel AOVs are replicated)
+    HDR_Image image(AOV aov) const;
+    /// Write all enabled AOVs as the layers of one multi-channel EXR file
+    std::string save_exr(std::string path) const;
+
+private:
+    size_t w = 0, h = 0;
+    bool on[(int)AOV::count] = {};
+    std::vector<float> planes[(int)AOV::count][3];
+};
+
+} // namespace PT
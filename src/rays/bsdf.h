@@ -30,6 +30,7 @@ struct BSDF_Lambertian {
 
     BSDF_Sample sample(Vec3 out_dir) const;
     Spectrum evaluate(Vec3 out_dir, Vec3 in_dir) const;
+    float pdf(Vec3 out_dir, Vec3 in_dir) const;
 
     Spectrum albedo;
     Samplers::Hemisphere::Uniform sampler;
@@ -42,6 +43,7 @@ struct BSDF_Mirror {
 
     BSDF_Sample sample(Vec3 out_dir) const;
     Spectrum evaluate(Vec3 out_dir, Vec3 in_dir) const;
+    float pdf(Vec3 out_dir, Vec3 in_dir) const;
 
     Spectrum reflectance;
 };
@@ -54,6 +56,7 @@ struct BSDF_Refract {
 
     BSDF_Sample sample(Vec3 out_dir) const;
     Spectrum evaluate(Vec3 out_dir, Vec3 in_dir) const;
+    float pdf(Vec3 out_dir, Vec3 in_dir) const;
 
     Spectrum transmittance;
     float index_of_refraction;
@@ -67,6 +70,7 @@ struct BSDF_Glass {
 
     BSDF_Sample sample(Vec3 out_dir) const;
     Spectrum evaluate(Vec3 out_dir, Vec3 in_dir) const;
+    float pdf(Vec3 out_dir, Vec3 in_dir) const;
 
     Spectrum transmittance;
     Spectrum reflectance;
@@ -80,6 +84,7 @@ struct BSDF_Diffuse {
 
     BSDF_Sample sample(Vec3 out_dir) const;
     Spectrum evaluate(Vec3 out_dir, Vec3 in_dir) const;
+    float pdf(Vec3 out_dir, Vec3 in_dir) const;
 
     Spectrum radiance;
     Samplers::Hemisphere::Uniform sampler;
@@ -114,6 +119,29 @@ public:
             underlying);
     }
 
+    float pdf(Vec3 out_dir, Vec3 in_dir) const {
+        return std::visit(
+            overloaded{[&out_dir, &in_dir](const auto& b) { return b.pdf(out_dir, in_dir); }},
+            underlying);
+    }
+
+    Spectrum emissive() const {
+        return std::visit(overloaded{[](const BSDF_Diffuse& d) { return d.radiance; },
+                                     [](const auto&) { return Spectrum{}; }},
+                          underlying);
+    }
+
+    /// Surface color used as a denoising feature
+    Spectrum albedo() const {
+        return std::visit(
+            overloaded{[](const BSDF_Lambertian& b) { return b.albedo; },
+                       [](const BSDF_Mirror& b) { return b.reflectance; },
+                       [](const BSDF_Glass& b) { return (b.reflectance + b.transmittance) * 0.5f; },
+                       [](const BSDF_Diffuse&) { return Spectrum(1.0f); },
+                       [](const BSDF_Refract& b) { return b.transmittance; }},
+            underlying);
+    }
+
     bool is_discrete() const {
         return std::visit(overloaded{[](const BSDF_Lambertian&) { return false; },
                                      [](const BSDF_Mirror&) { return true; },
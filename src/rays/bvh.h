@@ -4,6 +4,7 @@
 #include "../lib/mathlib.h"
 #include "../platform/gl.h"
 
+#include "ray_stats.h"
 #include "trace.h"
 
 namespace PT {
@@ -41,7 +42,8 @@ private:
     typedef typename std::vector<Primitive>::const_iterator PrimitivesCIterator;
 
 
-    void find_closest_hit(const Ray& ray,const Node& node, Trace& closest) const;
+    void find_closest_hit(const Ray& ray, const Ray_Box& box_ray, const Node& node,
+                          Trace& closest) const;
     void subdivide(size_t root_node_addr, Node& node, size_t max_leaf_size);
     size_t new_node(BBox box = {}, size_t start = 0, size_t size = 0, size_t l = 0, size_t r = 0);
 
@@ -0,0 +1,110 @@
+#include <functional>
+
+#include "../util/thread_pool.h"
+#include "denoiser.h"
+
+namespace PT {
+
+static const size_t tile_size = 32;
+
+static void for_tiles(size_t w, size_t h,
+                      const std::function<void(size_t, size_t, size_t, size_t)>& f) {
+
+    size_t tiles_x = (w + tile_size - 1) / tile_size;
+    size_t tiles_y = (h + tile_size - 1) / tile_size;
+    size_t n_tiles = tiles_x * tiles_y;
+
+    // Someone is always waiting on the result (the GUI or the frame writer), so
+    // the tiles go ahead of render work; if every worker is busy tracing, the
+    // caller filters the tiles itself instead of waiting for one to free up.
+    parallel_for(Thread_Pool::shared(), 0, n_tiles, 1, [&](size_t begin, size_t end) {
+        for(size_t t = begin; t < end; t++) {
+            size_t x = (t % tiles_x) * tile_size, y = (t / tiles_x) * tile_size;
+            f(x, y, std::min(x + tile_size, w), std::min(y + tile_size, h));
+        }
+    }, Priority::interactive);
+}
+
+static float dist2(Spectrum a, Spectrum b) {
+    Spectrum d = a - b;
+    return d.r * d.r + d.g * d.g + d.b * d.b;
+}
+
+HDR_Image denoise(const HDR_Image& color, const HDR_Image& albedo, const HDR_Image& normal,
+                  Denoise_Params params) {
+
+    static const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f,
+                                    1.0f / 16.0f};
+    static const float min_albedo = 0.01f;
+
+    auto [w, h] = color.dimension();
+    if(!w || !h || albedo.dimension() != color.dimension() ||
+       normal.dimension() != color.dimension()) {
+        return color.copy();
+    }
+
+    // Filter illumination rather than color so that albedo detail is kept
+    std::vector<Spectrum> src(w * h), dst(w * h);
+    for(size_t i = 0; i < w * h; i++) {
+        Spectrum a = albedo.at(i);
+        Spectrum c = color.at(i);
+        src[i] = Spectrum(c.r / std::max(a.r, min_albedo), c.g / std::max(a.g, min_albedo),
+                          c.b / std::max(a.b, min_albedo));
+    }
+
+    float sigma_color = params.sigma_color;
+    for(int iter = 0; iter < params.iterations; iter++) {
+
+        int step = 1 << iter;
+        float inv_c = 1.0f / (sigma_color * sigma_color);
+        float inv_n = 1.0f / (params.sigma_normal * params.sigma_normal);
+        float inv_a = 1.0f / (params.sigma_albedo * params.sigma_albedo);
+
+        for_tiles(w, h, [&](size_t x0, size_t y0, size_t x1, size_t y1) {
+            for(size_t y = y0; y < y1; y++) {
+                for(size_t x = x0; x < x1; x++) {
+
+                    Spectrum c_p = src[y * w + x];
+                    Spectrum t_p = c_p * (1.0f / (1.0f + c_p.luma()));
+                    Spectrum n_p = normal.at(x, y), a_p = albedo.at(x, y);
+
+                    Spectrum sum;
+                    float weights = 0.0f;
+                    for(int j = -2; j <= 2; j++) {
+                        int qy = (int)y + j * step;
+                        if(qy < 0 || qy >= (int)h) continue;
+                        for(int i = -2; i <= 2; i++) {
+                            int qx = (int)x + i * step;
+                            if(qx < 0 || qx >= (int)w) continue;
+
+                            Spectrum c_q = src[qy * w + qx];
+                            Spectrum t_q = c_q * (1.0f / (1.0f + c_q.luma()));
+                            float e = dist2(t_p, t_q) * inv_c +
+                                      dist2(n_p, normal.at(qx, qy)) * inv_n +
+                                      dist2(a_p, albedo.at(qx, qy)) * inv_a;
+                            float weight = kernel[i + 2] * kernel[j + 2] * std::exp(-e);
+
+                            sum += c_q * weight;
+                            weights += weight;
+                        }
+                    }
+                    dst[y * w + x] = weights > 0.0f ? sum * (1.0f / weights) : c_p;
+                }
+            }
+        });
+
+        std::swap(src, dst);
+        sigma_color *= 0.5f;
+    }
+
+    HDR_Image out(w, h);
+    for(size_t i = 0; i < w * h; i++) {
+        Spectrum a = albedo.at(i);
+        Spectrum c = src[i];
+        out.at(i) = Spectrum(c.r * std::max(a.r, min_albedo), c.g * std::max(a.g, min_albedo),
+                             c.b * std::max(a.b, min_albedo));
+    }
+    return out;
+}
+
+} // namespace PT
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../util/hdr_image.h"
+
+namespace PT {
+
+struct Denoise_Params {
+    // Filter passes; pass i reaches 2^(i+1) pixels to each side
+    int iterations = 5;
+    // Edge-stopping widths for (tonemapped) color, normal and albedo differences
+    float sigma_color = 0.5f;
+    float sigma_normal = 0.3f;
+    float sigma_albedo = 0.1f;
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010). The color is
+// divided by the first-hit albedo before filtering so that texture detail
+// survives, and the albedo and normal buffers stop the filter at edges.
+// Tiles are filtered in parallel.
+HDR_Image denoise(const HDR_Image& color, const HDR_Image& albedo, const HDR_Image& normal,
+                  Denoise_Params params = {});
+
+} // namespace PT
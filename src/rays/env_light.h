@@ -19,6 +19,7 @@ struct Env_Hemisphere {
 
     Light_Sample sample() const;
     Spectrum sample_direction(Vec3 dir) const;
+    float pdf(Vec3 dir) const;
 
     Spectrum radiance;
     Samplers::Hemisphere::Uniform sampler;
@@ -31,6 +32,7 @@ struct Env_Sphere {
 
     Light_Sample sample() const;
     Spectrum sample_direction(Vec3 dir) const;
+    float pdf(Vec3 dir) const;
 
     Spectrum radiance;
     Samplers::Sphere::Uniform sampler;
@@ -43,6 +45,7 @@ struct Env_Map {
 
     Light_Sample sample() const;
     Spectrum sample_direction(Vec3 dir) const;
+    float pdf(Vec3 dir) const;
 
     HDR_Image image;
     Samplers::Sphere::Image sampler;
@@ -77,6 +80,11 @@ public:
             underlying);
     }
 
+    /// Solid angle density with which sample() returns dir
+    float pdf(Vec3 dir) const {
+        return std::visit(overloaded{[&dir](const auto& h) { return h.pdf(dir); }}, underlying);
+    }
+
     bool is_discrete() const {
         return false;
     }
@@ -12,6 +12,10 @@ Light_Sample Directional_Light::sample(Vec3) const {
     return ret;
 }
 
+float Directional_Light::pdf(Vec3, Vec3) const {
+    return 0.0f;
+}
+
 Light_Sample Point_Light::sample(Vec3 from) const {
     Light_Sample ret;
     ret.direction = -from.unit();
@@ -21,6 +25,10 @@ Light_Sample Point_Light::sample(Vec3 from) const {
     return ret;
 }
 
+float Point_Light::pdf(Vec3, Vec3) const {
+    return 0.0f;
+}
+
 Light_Sample Spot_Light::sample(Vec3 from) const {
     Light_Sample ret;
     float angle = std::atan2(Vec2(from.x, from.z).norm(), from.y);
@@ -33,6 +41,10 @@ Light_Sample Spot_Light::sample(Vec3 from) const {
     return ret;
 }
 
+float Spot_Light::pdf(Vec3, Vec3) const {
+    return 0.0f;
+}
+
 Light_Sample Rect_Light::sample(Vec3 from) const {
     Light_Sample ret;
 
@@ -40,9 +52,9 @@ Light_Sample Rect_Light::sample(Vec3 from) const {
     Vec3 point(sample.x - size.x / 2.0f, 0.0f, sample.y - size.y / 2.0f);
     Vec3 dir = point - from;
 
-    float cos_theta = dir.y;
     float squared_dist = dir.norm_squared();
     float dist = std::sqrt(squared_dist);
+    float cos_theta = dir.y / dist;
 
     ret.direction = dir / dist;
     ret.distance = dist;
@@ -51,4 +63,17 @@ Light_Sample Rect_Light::sample(Vec3 from) const {
     return ret;
 }
 
+float Rect_Light::pdf(Vec3 from, Vec3 dir) const {
+
+    // Only directions reaching the emitting side count; sample() returns
+    // no radiance for the other side.
+    if(dir.y <= 0.0f || from.y >= 0.0f) return 0.0f;
+
+    float dist = -from.y / dir.y;
+    Vec3 point = from + dist * dir;
+    if(std::abs(point.x) > size.x / 2.0f || std::abs(point.z) > size.y / 2.0f) return 0.0f;
+
+    return (dist * dist) / (dir.y * size.x * size.y);
+}
+
 } // namespace PT
@@ -30,6 +30,7 @@ struct Directional_Light {
     }
 
     Light_Sample sample(Vec3 from) const;
+    float pdf(Vec3 from, Vec3 dir) const;
 
     Spectrum radiance;
     Samplers::Direction sampler;
@@ -41,6 +42,7 @@ struct Point_Light {
     }
 
     Light_Sample sample(Vec3 from) const;
+    float pdf(Vec3 from, Vec3 dir) const;
 
     Spectrum radiance;
     Samplers::Point sampler;
@@ -52,6 +54,7 @@ struct Spot_Light {
     }
 
     Light_Sample sample(Vec3 from) const;
+    float pdf(Vec3 from, Vec3 dir) const;
 
     Spectrum radiance;
     Vec2 angle_bounds;
@@ -64,6 +67,7 @@ struct Rect_Light {
     }
 
     Light_Sample sample(Vec3 from) const;
+    float pdf(Vec3 from, Vec3 dir) const;
 
     Spectrum radiance;
     Vec2 size;
@@ -102,6 +106,16 @@ public:
         return ret;
     }
 
+    /// Solid angle density with which sample(from) returns dir
+    float pdf(Vec3 from, Vec3 dir) const {
+        if(has_trans) {
+            from = itrans * from;
+            dir = itrans.rotate(dir).unit();
+        }
+        return std::visit(overloaded{[&from, &dir](const auto& l) { return l.pdf(from, dir); }},
+                          underlying);
+    }
+
     bool is_discrete() const {
         return std::visit(overloaded{[](const Directional_Light&) { return true; },
                                      [](const Point_Light&) { return true; },
@@ -43,12 +43,22 @@ public:
         return box;
     }
 
-    Trace hit(Ray ray) const {
-        if(has_trans) ray.transform(itrans);
-        Trace ret =
-            std::visit(overloaded{[&ray](const auto& o) { return o.hit(ray); }}, underlying);
+    Trace hit(const Ray& ray) const {
+        auto hit = [this](const Ray& r) {
+            return std::visit(overloaded{[&r](const auto& o) { return o.hit(r); }}, underlying);
+        };
+        // Only instances need a copy of the ray, in their own space
+        Trace ret;
+        if(has_trans) {
+            Ray local = ray;
+            local.transform(itrans);
+            ret = hit(local);
+        } else {
+            ret = hit(ray);
+        }
         if(ret.hit) {
             ret.material = material;
+            ret.id = _id;
             if(has_trans) ret.transform(trans, itrans.T());
         }
         return ret;
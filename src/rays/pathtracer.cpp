@@ -1,34 +1,72 @@
 
 #include "pathtracer.h"
+#include "denoiser.h"
 #include "../geometry/util.h"
 #include "../gui/render.h"
+#include "../util/profiler.h"
+#include "../util/rand.h"
 
 #include <SDL2/SDL.h>
+#include <functional>
 #include <thread>
 
 namespace PT {
 
+const char* Roulette_Policy_Names[(int)Roulette_Policy::count] = {"None", "Fixed", "Throughput",
+                                                                  "Splitting"};
+const char* MIS_Mode_Names[(int)MIS_Mode::count] = {"None", "Balance", "Power"};
+
 Pathtracer::Pathtracer(Gui::Widget_Render& gui, Vec2 screen_dim)
-    : thread_pool(std::thread::hardware_concurrency()), gui(gui), camera(screen_dim) {
+    : thread_pool(Thread_Pool::shared()), render_tasks(thread_pool, Priority::background),
+      gui(gui), camera(screen_dim) {
     accumulator_samples = 0;
     total_epochs = 0;
     completed_epochs = 0;
+    issued_epochs = 0;
     out_w = out_h = 0;
     n_samples = 0;
     n_area_samples = 0;
+    guide_pending = 0;
+    building = false;
 }
 
 Pathtracer::~Pathtracer() {
     cancel();
-    thread_pool.stop();
 }
 
-void Pathtracer::build_lights(Scene& layout_scene, std::vector<Object>& objs) {
-
-    lights.clear();
-    env_light.reset();
+// Approximate memory held by a traced mesh: vertices, triangles, and the
+// 2n - 1 nodes of a BVH with one triangle per leaf.
+static size_t mesh_bytes(size_t verts, size_t tris) {
+    size_t node = sizeof(BBox) + 4 * sizeof(size_t);
+    return verts * sizeof(Tri_Mesh_Vert) + tris * (sizeof(Triangle) + 2 * node);
+}
 
-    layout_scene.for_items([&, this](const Scene_Item& item) {
+// Results shared between the stages of a scene build. Each item of the layout
+// scene gets a slot for the objects it becomes, so the top level BVH is built
+// from them in scene order however the stages happen to be scheduled.
+struct Pathtracer::Scene_Build {
+    struct Slot {
+        // Mesh data copied out of the layout scene, with a transform per instance
+        std::vector<GL::Mesh::Vert> verts;
+        std::vector<GL::Mesh::Index> idxs;
+        std::vector<Mat4> transforms;
+
+        std::vector<Object> objs;
+        size_t bytes = 0;
+    };
+    Scene_Data data;
+    std::vector<Slot> slots;
+    std::optional<HDR_Image> env_map;
+};
+
+void Pathtracer::build_lights(Scene& layout_scene, Scene_Build& build, size_t slot) const {
+
+    Scene_Data& data = build.data;
+    std::vector<Light>& lights = data.lights;
+    std::vector<BSDF>& materials = data.materials;
+    std::unordered_map<Scene_ID, size_t> mat_cache;
+
+    layout_scene.for_items([&](const Scene_Item& item) {
         if(item.is<Scene_Light>()) {
 
             const Scene_Light& light = item.get<Scene_Light>();
@@ -40,13 +78,14 @@ void Pathtracer::build_lights(Scene& layout_scene, std::vector<Object>& objs) {
             } break;
             case Light_Type::sphere: {
                 if(light.opt.has_emissive_map) {
-                    env_light = Env_Light(Env_Map(light.emissive_copy()));
+                    // Its sampler is built in a later stage
+                    build.env_map = light.emissive_copy();
                 } else {
-                    env_light = Env_Light(Env_Sphere(r));
+                    data.env_light = Env_Light(Env_Sphere(r));
                 }
             } break;
             case Light_Type::hemisphere: {
-                env_light = Env_Light(Env_Hemisphere(r));
+                data.env_light = Env_Light(Env_Hemisphere(r));
             } break;
             case Light_Type::point: {
                 lights.push_back(Light(Point_Light(r), light.id(), light.pose.transform()));
@@ -69,9 +108,10 @@ void Pathtracer::build_lights(Scene& layout_scene, std::vector<Object>& objs) {
                     mat_cache[light.id()] = materials.size();
                     materials.push_back(BSDF(BSDF_Diffuse(r)));
                 }
-                objs.push_back(
-                    Object(std::move(Util::quad_mesh(light.opt.size.x, light.opt.size.y)),
-                           light.id(), idx, light.pose.transform()));
+                data.emitter_light[idx] = lights.size() - 1;
+                Util::Gen::Data quad = Util::Gen::quad(light.opt.size.x, light.opt.size.y);
+                build.slots[slot].objs.push_back(Object(Tri_Mesh(quad.verts, quad.elems),
+                                                        light.id(), idx, light.pose.transform()));
             } break;
             default: return;
             }
@@ -79,27 +119,38 @@ void Pathtracer::build_lights(Scene& layout_scene, std::vector<Object>& objs) {
     });
 }
 
-void Pathtracer::build_scene(Scene& layout_scene) {
-
-    // It would be nice to let the interface be usable here (as with
-    // the path-tracing part), but this would cause too much hassle with
-    // editing the scene while building BVHs from it.
-    // This could be worked around by first copying all the mesh data
-    // and then building the BVHs, but I don't think it's that big
-    // of a deal, as BVH building should take at most a few seconds
-    // even with many big meshes.
+Pathtracer::Build_Stages Pathtracer::build_scene(Scene& layout_scene, Scene_Build& build,
+                                                 Task_Graph& graph) const {
 
     // We could also do instancing instead of duplicating the bvh
     // for big meshes, but that's something to add in the future
 
-    // Yeah this could just be a list of futures but future wanted a
-    // default constructor for Object so whatever
-    std::mutex obj_mut;
-    std::vector<Object> obj_list;
-    materials.clear();
-    mat_cache.clear();
+    // Each mesh is copied out of the layout scene in one stage and gets its BVH
+    // in another, so only the copies hold up editing. The lights are built
+    // alongside them, and the environment map's sampler and the top level BVH
+    // as soon as what they need is ready.
+    Scene_Data& data = build.data;
+    std::vector<BSDF>& materials = data.materials;
+    std::vector<Task_Graph::Node> reads, builds;
+
+    // Turns the mesh copied into a slot into one object per transform
+    auto build_mesh = [&build](size_t slot, Scene_ID id, unsigned int idx) {
+        return [&build, slot, id, idx]() {
+            Profiler::Zone zone("Build mesh BVH");
+            Scene_Build::Slot& out = build.slots[slot];
+            Tri_Mesh mesh(out.verts, out.idxs);
+            size_t bytes = mesh_bytes(out.verts.size(), out.idxs.size() / 3);
+            out.bytes += out.transforms.size() * bytes;
+            for(size_t i = 0; i < out.transforms.size(); i++) {
+                Tri_Mesh instance = i + 1 < out.transforms.size() ? mesh.copy() : std::move(mesh);
+                out.objs.push_back(Object(std::move(instance), id, idx, out.transforms[i]));
+            }
+            out.verts = {};
+            out.idxs = {};
+        };
+    };
 
-    layout_scene.for_items([&, this](Scene_Item& item) {
+    layout_scene.for_items([&](Scene_Item& item) {
         if(item.is<Scene_Object>()) {
 
             Scene_Object& obj = item.get<Scene_Object>();
@@ -125,19 +176,25 @@ void Pathtracer::build_scene(Scene& layout_scene) {
             default: return;
             }
 
-            thread_pool.enqueue([&, idx]() {
-                if(obj.is_shape()) {
-                    Shape shape(obj.opt.shape);
-                    std::lock_guard<std::mutex> lock(obj_mut);
-                    obj_list.push_back(
-                        Object(std::move(shape), obj.id(), idx, obj.pose.transform()));
-                } else {
-                    Tri_Mesh mesh(obj.posed_mesh());
-                    std::lock_guard<std::mutex> lock(obj_mut);
-                    obj_list.push_back(
-                        Object(std::move(mesh), obj.id(), idx, obj.pose.transform()));
-                }
+            size_t slot = build.slots.size();
+            build.slots.emplace_back();
+
+            if(obj.is_shape()) {
+                build.slots[slot].objs.push_back(
+                    Object(Shape(obj.opt.shape), obj.id(), idx, obj.pose.transform()));
+                return;
+            }
+
+            Task_Graph::Node copy = graph.add([&build, &obj, slot]() {
+                Profiler::Zone zone("Copy object");
+                Scene_Build::Slot& out = build.slots[slot];
+                const GL::Mesh& posed = obj.posed_mesh();
+                out.verts = posed.verts();
+                out.idxs = posed.indices();
+                out.transforms = {obj.pose.transform()};
             });
+            reads.push_back(copy);
+            builds.push_back(graph.add(build_mesh(slot, obj.id(), idx), {copy}));
 
         } else if(item.is<Scene_Particles>()) {
 
@@ -145,25 +202,85 @@ void Pathtracer::build_scene(Scene& layout_scene) {
             unsigned int idx = (unsigned int)materials.size();
             materials.push_back(BSDF(BSDF_Diffuse(particles.opt.color)));
 
-            thread_pool.enqueue([&, idx]() {
-                Tri_Mesh mesh(particles.mesh());
-
-                const auto& parts = particles.get_particles();
-                for(const Particle& p : parts) {
-                    Tri_Mesh copy = mesh.copy();
-                    Mat4 T = Mat4::translate(p.pos) * Mat4::scale(Vec3{particles.opt.scale});
-
-                    std::lock_guard<std::mutex> lock(obj_mut);
-                    obj_list.push_back(Object(std::move(copy), particles.id(), idx, T));
+            size_t slot = build.slots.size();
+            build.slots.emplace_back();
+
+            Task_Graph::Node copy = graph.add([&build, &particles, slot]() {
+                Profiler::Zone zone("Copy particles");
+                Scene_Build::Slot& out = build.slots[slot];
+                out.verts = particles.mesh().verts();
+                out.idxs = particles.mesh().indices();
+                for(const Particle& p : particles.get_particles()) {
+                    out.transforms.push_back(Mat4::translate(p.pos) *
+                                             Mat4::scale(Vec3{particles.opt.scale}));
                 }
             });
+            reads.push_back(copy);
+            builds.push_back(graph.add(build_mesh(slot, particles.id(), idx), {copy}));
         }
     });
 
-    thread_pool.wait();
-    build_lights(layout_scene, obj_list);
+    // Object materials are all added by now, so the lights can append theirs
+    size_t light_slot = build.slots.size();
+    build.slots.emplace_back();
+    Task_Graph::Node lights =
+        graph.add([this, &layout_scene, &build, light_slot]() {
+            Profiler::Zone zone("Build lights");
+            build_lights(layout_scene, build, light_slot);
+        });
+    reads.push_back(lights);
+
+    Task_Graph::Node env = graph.add(
+        [&build]() {
+            if(build.env_map) {
+                Profiler::Zone zone("Build environment map");
+                build.data.env_light = Env_Light(Env_Map(std::move(*build.env_map)));
+                build.env_map.reset();
+            }
+        },
+        {lights});
+
+    Task_Graph::Node read = graph.add([]() {}, reads);
+    builds.push_back(read);
+
+    Task_Graph::Node bvh = graph.add(
+        [&build]() {
+            Profiler::Zone zone("Build scene BVH");
+            std::vector<Object> objs;
+            for(Scene_Build::Slot& slot : build.slots) {
+                build.data.bytes += slot.bytes;
+                for(Object& obj : slot.objs) objs.push_back(std::move(obj));
+            }
+            build.slots.clear();
+            build.data.bytes += objs.size() * sizeof(Object);
+            build.data.objects.build(std::move(objs));
+        },
+        builds);
+
+    return {read, graph.add([]() {}, {bvh, env})};
+}
+
+Scene_Data Pathtracer::prepare_scene(Scene& layout_scene) const {
+
+    // Runs on the calling thread, leaving the pool to the frame being traced
+    Scene_Build build;
+    build.data.build_time = SDL_GetPerformanceCounter();
+    {
+        Task_Graph graph(thread_pool);
+        build_scene(layout_scene, build, graph);
+        graph.run_inline();
+    }
+    build.data.build_time = SDL_GetPerformanceCounter() - build.data.build_time;
+    return std::move(build.data);
+}
 
-    scene.build(std::move(obj_list));
+void Pathtracer::use_scene(Scene_Data&& data) {
+    scene = std::move(data.objects);
+    lights = std::move(data.lights);
+    materials = std::move(data.materials);
+    env_light = std::move(data.env_light);
+    emitter_light = std::move(data.emitter_light);
+    guide.reset(scene.bbox());
 }
 
 void Pathtracer::set_sizes(size_t w, size_t h, size_t samples, size_t area_samples, size_t depth) {
@@ -175,49 +292,397 @@ void Pathtracer::set_sizes(size_t w, size_t h, size_t samples, size_t area_sampl
     accumulator.resize(out_w, out_h);
 }
 
+void Pathtracer::set_time_budget(float seconds) {
+    time_budget = std::max(seconds, 0.0f);
+}
+
+void Pathtracer::set_seed(unsigned int s) {
+    seed = s;
+}
+
+void Pathtracer::set_roulette(Roulette_Policy policy, size_t min_depth) {
+    roulette_policy = policy;
+    roulette_depth = min_depth;
+}
+
+void Pathtracer::set_mis(MIS_Mode mode) {
+    mis_mode = mode;
+}
+
+void Pathtracer::set_guiding(bool enable) {
+    guiding = enable;
+}
+
+void Pathtracer::set_denoise(bool enable) {
+    denoise = enable;
+    denoised_dirty = true;
+}
+
+void Pathtracer::set_aov(AOV aov, bool enable) {
+    aov_enabled[(int)aov] = enable;
+}
+
+const AOV_Buffers& Pathtracer::get_aovs() const {
+    return aovs;
+}
+
+bool Pathtracer::has_aovs() const {
+    for(int a = 0; a < (int)AOV::count; a++) {
+        if(aov_enabled[a]) return true;
+    }
+    return false;
+}
+
 void Pathtracer::log_ray(const Ray& ray, float t, Spectrum color) {
-    gui.log_ray(ray, t, color);
+    if(ray_log.enabled()) ray_log.add(ray.point, ray.at(t), color);
+}
+
+Ray_Log& Pathtracer::get_ray_log() {
+    return ray_log;
+}
+
+// First-hit data for the sample this thread is tracing
+static thread_local AOV_Sample aov_sample;
+
+void Pathtracer::record_hit(const Path& path, const Trace& hit, const BSDF& bsdf) {
+    if(!capture_aovs || path.depth > 0) return;
+    aov_sample.hit = true;
+    aov_sample.depth = hit.distance;
+    aov_sample.normal = hit.normal;
+    aov_sample.albedo = bsdf.albedo();
+    aov_sample.material = hit.material;
+    aov_sample.object = hit.id;
+}
+
+size_t Pathtracer::split_paths(const Path& path, float& weight) const {
+
+    // Splitting policy: before roulette starts, a path whose throughput has grown
+    // above one continues as several independent paths of proportionally smaller
+    // weight. The count is rounded stochastically so the expected weight stays one.
+    static const float max_split = 4.0f;
+
+    weight = 1.0f;
+    if(roulette_policy != Roulette_Policy::splitting || path.depth >= roulette_depth) return 1;
+
+    float luma = path.beta.luma();
+    if(!(luma > 1.0f)) return 1;
+
+    float n = std::min(luma, max_split);
+    weight = 1.0f / n;
+    return (size_t)n + (RNG::coin_flip(frac(n)) ? 1 : 0);
 }
 
-void Pathtracer::accumulate(const HDR_Image& sample) {
+bool Pathtracer::roulette(size_t depth, Spectrum& beta) const {
+
+    // A path that can no longer carry any light is never worth tracing
+    float luma = beta.luma();
+    if(luma <= 0.0f) return false;
+    if(depth < roulette_depth) return true;
+
+    float survive = 1.0f;
+    switch(roulette_policy) {
+    case Roulette_Policy::none: return true;
+    case Roulette_Policy::fixed: survive = 0.75f; break;
+    case Roulette_Policy::throughput:
+    case Roulette_Policy::splitting: survive = clamp(luma, 0.05f, 1.0f); break;
+    default: break;
+    }
+
+    if(survive >= 1.0f) return true;
+    if(!RNG::coin_flip(survive)) {
+        Ray_Stats::count(&Ray_Stats::roulette_kills);
+        return false;
+    }
+    beta *= 1.0f / survive;
+    return true;
+}
+
+float Pathtracer::mis_weight(float n_f, float pdf_f, float n_g, float pdf_g) const {
+
+    // Weight for a sample drawn from strategy f when strategy g could also have
+    // produced it, with n_f and n_g samples taken from each.
+    float f = n_f * pdf_f, g = n_g * pdf_g;
+    if(mis_mode == MIS_Mode::power) {
+        f *= f;
+        g *= g;
+    }
+    float sum = f + g;
+    return sum > 0.0f ? f / sum : 0.0f;
+}
+
+float Pathtracer::emission_weight(const Path& path, float pdf) const {
+
+    // Camera rays and rays leaving delta BSDFs cannot be matched by light
+    // sampling, so they keep all of the emission they find.
+    if(path.pdf <= 0.0f) return 1.0f;
+    return mis_weight(1.0f, path.pdf, (float)n_area_samples, pdf);
+}
+
+float Pathtracer::light_pdf(const Ray& ray, int material) const {
+    auto entry = emitter_light.find((size_t)material);
+    if(entry == emitter_light.end()) return 0.0f;
+    return lights[entry->second].pdf(ray.point, ray.dir);
+}
+
+// Share of scattered directions drawn from the guide where one is available
+static const float guide_fraction = 0.5f;
+
+BSDF_Sample Pathtracer::sample_scatter(const BSDF& bsdf, Vec3 pos, Vec3 out_dir,
+                                       const Frame& frame) const {
+
+    BSDF_Sample sample = bsdf.sample(out_dir);
+    if(!guiding || bsdf.is_discrete()) return sample;
+
+    const D_Tree* dist = guide.sampler(pos);
+    if(!dist) return sample;
+
+    // Pick one of the two strategies and report the density of the mixture
+    float bsdf_pdf = sample.pdf, guide_pdf = 0.0f;
+    if(RNG::coin_flip(guide_fraction)) {
+        Vec3 in_dir = frame.to_local(dist->sample(guide_pdf));
+        sample.direction = in_dir;
+        sample.attenuation = bsdf.evaluate(out_dir, in_dir);
+        bsdf_pdf = bsdf.pdf(out_dir, in_dir);
+    } else {
+        guide_pdf = dist->pdf(frame.to_world(sample.direction));
+    }
+    sample.pdf = guide_fraction * guide_pdf + (1.0f - guide_fraction) * bsdf_pdf;
+    return sample;
+}
+
+float Pathtracer::scatter_pdf(const BSDF& bsdf, Vec3 pos, Vec3 out_dir, Vec3 in_dir,
+                              const Frame& frame) const {
+
+    float bsdf_pdf = bsdf.pdf(out_dir, in_dir);
+    if(!guiding || bsdf.is_discrete()) return bsdf_pdf;
 
+    const D_Tree* dist = guide.sampler(pos);
+    if(!dist) return bsdf_pdf;
+
+    float guide_pdf = dist->pdf(frame.to_world(in_dir));
+    return guide_fraction * guide_pdf + (1.0f - guide_fraction) * bsdf_pdf;
+}
+
+void Pathtracer::record_guide(Vec3 pos, Vec3 dir, Spectrum radiance, Spectrum beta, float pdf) {
+
+    if(!guide_training || pdf <= 0.0f) return;
+
+    // The traced radiance already carries the path throughput; divide it back
+    // out to get the radiance arriving at pos.
+    Spectrum incident;
+    for(int i = 0; i < 3; i++) {
+        incident.data[i] = beta.data[i] > 0.0f ? radiance.data[i] / beta.data[i] : 0.0f;
+    }
+    guide.record(pos, dir, incident.luma() / pdf);
+}
+
+void Pathtracer::accumulate(const HDR_Image& sample, const AOV_Buffers& sample_aovs,
+                            size_t samples) {
+
+    Profiler::Zone zone("Accumulate");
+    Collect_Stats collect(ray_stats, stats_mut, &Ray_Stats::accumulate_time);
     std::lock_guard<std::mutex> lock(accumulator_mut);
 
-    accumulator_samples++;
+    // Epochs are weighted by how many samples they traced, so the short guide
+    // training passes count for no more than they are worth.
+    accumulator_samples += samples;
+    float k = (float)samples / accumulator_samples;
     for(size_t j = 0; j < out_h; j++) {
-        for(size_t i = 0; i < out_w; i++) {
-            Spectrum& s = accumulator.at(i, j);
-            const Spectrum& n = sample.at(i, j);
-            s += (n - s) * (1.0f / accumulator_samples);
-        }
+        Spectrum* s = accumulator.row(j);
+        const Spectrum* n = sample.row(j);
+        for(size_t i = 0; i < out_w; i++) s[i] += (n[i] - s[i]) * k;
     }
+    accumulator.mark(0, 0, out_w, out_h);
+
+    if(capture_aovs) aovs.accumulate(sample_aovs, k);
+    denoised_dirty = true;
 }
 
-void Pathtracer::do_trace(size_t samples) {
+void Pathtracer::do_trace(size_t samples, size_t epoch) {
+
+    Profiler::Zone zone("Trace epoch");
 
     HDR_Image sample(out_w, out_h);
+    AOV_Buffers sample_aovs;
+    if(capture_aovs) {
+        for(int a = 0; a < (int)AOV::count; a++) sample_aovs.enable((AOV)a, aovs.enabled((AOV)a));
+        sample_aovs.resize(out_w, out_h);
+    }
+    bool timed = capture_aovs && aovs.enabled(AOV::time);
+    double freq = (double)SDL_GetPerformanceFrequency();
+
+    // Camera rays are generated for a whole row at once, one sample per pixel at a time
+    std::vector<Vec2> coords(out_w);
+    std::vector<size_t> sampled(out_w);
+    Camera_Rays rays;
+
     for(size_t j = 0; j < out_h; j++) {
-        for(size_t i = 0; i < out_w; i++) {
+        {
+            // Rows are collected one at a time, so work run by yield() isn't counted
+            Profiler::Zone row_zone("Trace row");
+            Collect_Stats collect(ray_stats, stats_mut, &Ray_Stats::trace_time);
+            if(seed) RNG::seed(seed, epoch * out_h + j);
+            std::fill(sampled.begin(), sampled.end(), size_t(0));
 
-            size_t sampled = 0;
             for(size_t s = 0; s < samples; s++) {
 
-                Spectrum p = trace_pixel(i, j);
-                if(p.valid()) {
-                    sample.at(i, j) += p;
-                    sampled++;
+                for(size_t i = 0; i < out_w; i++) coords[i] = sample_pixel(i, j);
+                camera.generate_rays(coords.data(), out_w, rays);
+
+                for(size_t i = 0; i < out_w; i++) {
+
+                    Uint64 start = timed ? SDL_GetPerformanceCounter() : 0;
+
+                    aov_sample = {};
+                    Ray_Stats::count_ray(&Ray_Stats::camera_rays);
+                    Spectrum p = trace_ray(rays.get(i), Path{});
+                    if(p.valid()) {
+                        sample.at(i, j) += p;
+                        if(capture_aovs) {
+                            sample_aovs.add_sample(j * out_w + i, aov_sample, sampled[i]);
+                        }
+                        sampled[i]++;
+                    }
+
+                    if(timed) {
+                        Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+                        sample_aovs.add_time(j * out_w + i, (float)(elapsed / freq));
+                    }
+
+                    if(cancel_flag) return;
                 }
+            }
+            for(size_t i = 0; i < out_w; i++) sample.at(i, j) *= (1.0f / sampled[i]);
+        }
+
+        // Renders share the pool with the editor, so let its work go first
+        thread_pool.yield(Priority::background);
 
-                if(cancel_flag) return;
+        // Drop a partial epoch once the budget runs out, but only once there
+        // is already something in the accumulator to show for it.
+        if(time_budget > 0.0f && accumulator_samples.load() > 0 && out_of_time()) return;
+    }
+    accumulate(sample, sample_aovs, samples);
+}
+
+bool Pathtracer::out_of_time() const {
+    return SDL_GetPerformanceCounter() >= deadline;
+}
+
+void Pathtracer::enqueue_epoch(size_t samples) {
+    size_t epoch = issued_epochs++;
+    render_tasks.run([samples, epoch, this]() {
+        do_trace(samples, epoch);
+        if(time_budget > 0.0f && !out_of_time()) {
+            // Take epoch_mut so cancel() can't skip the render tasks between
+            // the check and the enqueue.
+            std::lock_guard<std::mutex> lock(epoch_mut);
+            if(!cancel_flag) {
+                total_epochs++;
+                enqueue_epoch(samples);
             }
-            sample.at(i, j) *= (1.0f / sampled);
+        }
+        finish_epoch();
+    });
+}
+
+size_t Pathtracer::count_epochs(size_t samples) const {
+    size_t n_threads = std::thread::hardware_concurrency();
+    size_t samples_per_epoch = std::max(size_t(1), n_samples / (n_threads * 10));
+    if(time_budget > 0.0f) return n_threads;
+    return samples / samples_per_epoch + !!(samples % samples_per_epoch);
+}
+
+void Pathtracer::enqueue_epochs(size_t samples) {
+
+    size_t n_threads = std::thread::hardware_concurrency();
+    size_t samples_per_epoch = std::max(size_t(1), n_samples / (n_threads * 10));
+
+    if(time_budget > 0.0f) {
+
+        // Keep one progressive epoch in flight per thread; each finished epoch
+        // issues another until the deadline passes.
+        for(size_t i = 0; i < n_threads; i++) {
+            enqueue_epoch(samples_per_epoch);
+        }
+
+    } else {
+
+        for(size_t s = 0; s < samples; s += samples_per_epoch) {
+            size_t epoch =
+                (s + samples_per_epoch) > samples ? samples - s : samples_per_epoch;
+            enqueue_epoch(epoch);
         }
     }
-    accumulate(sample);
+}
+
+void Pathtracer::enqueue_guide_pass(size_t pass) {
+
+    // Every thread traces the whole image at 2^pass samples per pixel. The
+    // last one to finish refines the guide, so the tree is never read and
+    // rebuilt at the same time.
+    size_t n_threads = std::thread::hardware_concurrency();
+    size_t samples = size_t(1) << pass;
+
+    guide_training = true;
+    guide_pending = n_threads;
+    for(size_t i = 0; i < n_threads; i++) {
+        size_t epoch = issued_epochs++;
+        render_tasks.run([pass, samples, epoch, this]() {
+            do_trace(samples, epoch);
+            if(guide_pending.fetch_sub(1) == 1) finish_guide_pass(pass);
+            finish_epoch();
+        });
+    }
+}
+
+void Pathtracer::finish_guide_pass(size_t pass) {
+
+    size_t n_threads = std::thread::hardware_concurrency();
+    size_t pass_samples = n_threads << pass;
+    guide.refine((size_t)(12000.0f * std::sqrt((float)pass_samples)));
+
+    std::lock_guard<std::mutex> lock(epoch_mut);
+    if(cancel_flag) return;
+
+    bool again = pass + 1 < guide_passes;
+    if(time_budget > 0.0f) {
+        Uint64 half = (Uint64)(time_budget * 0.5f * SDL_GetPerformanceFrequency());
+        again = SDL_GetPerformanceCounter() + half < deadline;
+        total_epochs += n_threads;
+    }
+
+    if(again) {
+        enqueue_guide_pass(pass + 1);
+    } else {
+        guide_training = false;
+        size_t trained = n_threads * ((size_t(2) << pass) - 1);
+        enqueue_epochs(n_samples - std::min(n_samples, trained));
+    }
+}
+
+void Pathtracer::finish_epoch() {
+    size_t completed = completed_epochs.fetch_add(1);
+    if(completed + 1 == total_epochs) {
+        Uint64 done = SDL_GetPerformanceCounter();
+        render_time = done - render_time;
+        { std::lock_guard<std::mutex> lock(epoch_mut); }
+        epoch_cond.notify_all();
+    }
 }
 
 bool Pathtracer::in_progress() const {
-    return completed_epochs.load() < total_epochs;
+    return building.load() || completed_epochs.load() < total_epochs.load();
+}
+
+void Pathtracer::wait() {
+    std::unique_lock<std::mutex> lock(epoch_mut);
+    epoch_cond.wait(lock, [this] { return !in_progress(); });
+}
+
+bool Pathtracer::wait_for(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(epoch_mut);
+    return epoch_cond.wait_for(lock, timeout, [this] { return !in_progress(); });
 }
 
 std::pair<float, float> Pathtracer::completion_time() const {
@@ -225,61 +690,198 @@ std::pair<float, float> Pathtracer::completion_time() const {
     return {(float)(build_time / freq), (float)(render_time / freq)};
 }
 
+Ray_Stats Pathtracer::stats() const {
+    Ray_Stats ret;
+    {
+        std::lock_guard<std::mutex> lock(stats_mut);
+        ret = ray_stats;
+    }
+    if(!in_progress()) {
+        auto [build, render] = completion_time();
+        ret.build_time = build;
+        ret.render_time = render;
+    }
+    return ret;
+}
+
 float Pathtracer::progress() const {
-    return (float)completed_epochs.load() / (float)total_epochs;
+    if(building) return 0.0f;
+    if(time_budget > 0.0f && in_progress()) {
+        Uint64 now = SDL_GetPerformanceCounter();
+        double left = now < deadline ? (double)(deadline - now) : 0.0;
+        return 1.0f - (float)(left / SDL_GetPerformanceFrequency()) / time_budget;
+    }
+    return (float)completed_epochs.load() / (float)total_epochs.load();
 }
 
 size_t Pathtracer::visualize_bvh(GL::Lines& lines, GL::Lines& active, size_t depth) {
+    if(build_graph) build_graph->wait();
     return scene.visualize(lines, active, depth, Mat4::I);
 }
 
-void Pathtracer::begin_render(Scene& layout_scene, const Camera& cam, bool add_samples) {
+void Pathtracer::reset_output() {
+    accumulator.clear({});
+    accumulator_samples = 0;
+    {
+        std::lock_guard<std::mutex> lock(stats_mut);
+        ray_stats = {};
+    }
 
-    size_t n_threads = std::thread::hardware_concurrency();
-    size_t samples_per_epoch = std::max(size_t(1), n_samples / (n_threads * 10));
+    // The denoiser needs the albedo and normal buffers whether or not they were asked for
+    for(int a = 0; a < (int)AOV::count; a++) aovs.enable((AOV)a, aov_enabled[a]);
+    if(denoise) {
+        aovs.enable(AOV::albedo, true);
+        aovs.enable(AOV::normal, true);
+    }
+    aovs.resize(out_w, out_h);
+    capture_aovs = aovs.any();
+}
+
+void Pathtracer::begin_render(Scene& layout_scene, const Camera& cam, bool add_samples) {
 
     cancel();
-    total_epochs = n_samples / samples_per_epoch + !!(n_samples % samples_per_epoch);
-
-    if(!add_samples) {
-        accumulator.clear({});
-        accumulator_samples = 0;
-        build_time = SDL_GetPerformanceCounter();
-        build_scene(layout_scene);
-        build_time = SDL_GetPerformanceCounter() - build_time;
+
+    if(add_samples) {
+        start_render(cam, true);
+        return;
     }
+
+    reset_output();
+    build_time = SDL_GetPerformanceCounter();
+    building = true;
+
+    // Tracing starts from the last stage of the build. We only wait for the
+    // stages that copy from the layout scene, since it may be edited afterwards;
+    // the BVHs and the environment map's sampler are built from the copies.
+    auto build = std::make_shared<Scene_Build>();
+    build_graph.emplace(thread_pool);
+    Build_Stages stages = build_scene(layout_scene, *build, *build_graph);
+    build_graph->add(
+        [this, build, cam]() {
+            build_time = SDL_GetPerformanceCounter() - build_time;
+            use_scene(std::move(build->data));
+
+            std::lock_guard<std::mutex> lock(epoch_mut);
+            if(!cancel_flag) start_render(cam, false);
+            building = false;
+            epoch_cond.notify_all();
+        },
+        {stages.done});
+    build_graph->run();
+    build_graph->wait(stages.read);
+}
+
+void Pathtracer::begin_render(Scene_Data&& data, const Camera& cam) {
+
+    cancel();
+
+    reset_output();
+    build_time = data.build_time;
+    use_scene(std::move(data));
+    start_render(cam, false);
+}
+
+void Pathtracer::start_render(const Camera& cam, bool add_samples) {
+
+    size_t n_threads = std::thread::hardware_concurrency();
+
     render_time = SDL_GetPerformanceCounter();
     
     camera = cam;
+    if(!add_samples) issued_epochs = 0;
 
-    for(size_t s = 0; s < n_samples; s += samples_per_epoch) {
-        size_t samples = (s + samples_per_epoch) > n_samples ? n_samples - s : samples_per_epoch;
-        thread_pool.enqueue([samples, this]() {
-            do_trace(samples);
-            size_t completed = completed_epochs.fetch_add(1);
-            if(completed + 1 == total_epochs) {
-                Uint64 done = SDL_GetPerformanceCounter();
-                render_time = done - render_time;
-            }
-        });
+    if(time_budget > 0.0f) {
+        deadline = render_time + (Uint64)(time_budget * SDL_GetPerformanceFrequency());
+    }
+
+    // Train the guide on up to half of the samples (or half of the time budget)
+    // before rendering the rest with it. Adding samples reuses the last guide.
+    guide_training = false;
+    guide_passes = 0;
+    if(guiding && !add_samples) {
+        while(n_threads * ((size_t(2) << guide_passes) - 1) <= n_samples / 2) guide_passes++;
+        if(time_budget > 0.0f) guide_passes = 1;
+    }
+
+    if(guide_passes > 0) {
+        size_t trained = n_threads * ((size_t(1) << guide_passes) - 1);
+        total_epochs = time_budget > 0.0f ? n_threads
+                                          : n_threads * guide_passes + count_epochs(n_samples - trained);
+        enqueue_guide_pass(0);
+    } else {
+        total_epochs = count_epochs(n_samples);
+        enqueue_epochs(n_samples);
     }
 }
 
 void Pathtracer::cancel() {
-    cancel_flag = true;
-    thread_pool.clear();
+    {
+        std::lock_guard<std::mutex> lock(epoch_mut);
+        cancel_flag = true;
+    }
+    if(build_graph) {
+        build_graph->wait();
+        build_graph.reset();
+    }
+    render_tasks.cancel();
+    render_tasks.wait();
     completed_epochs = 0;
     total_epochs = 0;
     cancel_flag = false;
     build_time = 0;
     render_time = SDL_GetPerformanceCounter() - render_time;
+    epoch_cond.notify_all();
+}
+
+bool Pathtracer::denoised_ready() {
+
+    // Denoise once the render has finished; progressive previews show the raw image.
+    if(!denoise || in_progress() || accumulator_samples.load() == 0) return false;
+    if(!aovs.enabled(AOV::albedo) || !aovs.enabled(AOV::normal)) return false;
+    if(aovs.dimension() != accumulator.dimension()) return false;
+
+    std::lock_guard<std::mutex> lock(accumulator_mut);
+    if(denoised_dirty) {
+        denoised = PT::denoise(accumulator, aovs.image(AOV::albedo), aovs.image(AOV::normal));
+        denoised_dirty = false;
+    }
+    return true;
 }
 
 const HDR_Image& Pathtracer::get_output() {
+    if(denoised_ready()) return denoised;
+    return accumulator;
+}
+
+const HDR_Image& Pathtracer::get_raw_output() {
     return accumulator;
 }
 
+HDR_Image Pathtracer::take_output() {
+
+    // Move the finished image out instead of copying it; the accumulator is
+    // reallocated for the next render.
+    if(denoised_ready()) {
+        denoised_dirty = true;
+        return std::move(denoised);
+    }
+
+    std::lock_guard<std::mutex> lock(accumulator_mut);
+    HDR_Image ret = std::move(accumulator);
+    accumulator.resize(out_w, out_h);
+    accumulator_samples = 0;
+    return ret;
+}
+
+AOV_Buffers Pathtracer::take_aovs() {
+    std::lock_guard<std::mutex> lock(accumulator_mut);
+    AOV_Buffers ret = std::move(aovs);
+    aovs.resize(out_w, out_h);
+    return ret;
+}
+
 const GL::Tex2D& Pathtracer::get_output_texture(float exposure) {
+    if(denoised_ready()) return denoised.get_texture(exposure);
     std::lock_guard<std::mutex> lock(accumulator_mut);
     return accumulator.get_texture(exposure);
 }
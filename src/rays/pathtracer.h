@@ -2,6 +2,8 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <unordered_map>
 
@@ -10,10 +12,14 @@
 #include "../util/hdr_image.h"
 #include "../util/thread_pool.h"
 
+#include "aov.h"
 #include "bsdf.h"
 #include "env_light.h"
 #include "light.h"
 #include "object.h"
+#include "ray_log.h"
+#include "ray_stats.h"
+#include "sd_tree.h"
 
 namespace Gui {
 class Widget_Render;
@@ -21,54 +27,175 @@ class Widget_Render;
 
 namespace PT {
 
+enum class Roulette_Policy : int { none, fixed, throughput, splitting, count };
+extern const char* Roulette_Policy_Names[(int)Roulette_Policy::count];
+
+enum class MIS_Mode : int { none, balance, power, count };
+extern const char* MIS_Mode_Names[(int)MIS_Mode::count];
+
+// What the integrator carries along a path besides the ray it is tracing, which
+// only holds what traversal needs
+struct Path {
+    /// Total attenuation new light will be scaled by to get to the camera
+    Spectrum beta = Spectrum(1.0f);
+    /// Number of bounces so far
+    size_t depth = 0;
+    /// Density of the BSDF sample that created the ray (0 for camera and delta rays)
+    float pdf = 0.0f;
+    /// Color the ray is drawn with in the ray log
+    Spectrum rcolor = Spectrum(0.0f);
+};
+
+// Everything a render traces against, built from a snapshot of the layout scene.
+// Once built it no longer refers to the layout scene, so the next animation frame
+// can be prepared while the current one is tracing.
+struct Scene_Data {
+    BVH<Object> objects;
+    std::vector<Light> lights;
+    std::vector<BSDF> materials;
+    std::optional<Env_Light> env_light;
+    std::unordered_map<size_t, size_t> emitter_light;
+
+    unsigned long long build_time = 0;
+    size_t bytes = 0; // rough estimate of the memory held
+};
+
 class Pathtracer {
 public:
     Pathtracer(Gui::Widget_Render& gui, Vec2 screen_dim);
     ~Pathtracer();
 
     void set_sizes(size_t w, size_t h, size_t pixel_samples, size_t area_samples, size_t depth);
+    void set_time_budget(float seconds);
+    /// Seed each row of each epoch from seed so renders repeat exactly; 0 seeds randomly
+    void set_seed(unsigned int seed);
+    void set_roulette(Roulette_Policy policy, size_t min_depth);
+    void set_mis(MIS_Mode mode);
+    void set_guiding(bool enable);
+    void set_denoise(bool enable);
+    void set_aov(AOV aov, bool enable);
 
     const HDR_Image& get_output();
+    const HDR_Image& get_raw_output();
+    HDR_Image take_output();
+    AOV_Buffers take_aovs();
+    const AOV_Buffers& get_aovs() const;
+    bool has_aovs() const;
     const GL::Tex2D& get_output_texture(float exposure);
+    Ray_Log& get_ray_log();
     size_t visualize_bvh(GL::Lines& lines, GL::Lines& active, size_t level);
 
     void begin_render(Scene& scene, const Camera& camera, bool add_samples = false);
+    void begin_render(Scene_Data&& data, const Camera& camera);
+    Scene_Data prepare_scene(Scene& scene) const;
     void cancel();
     bool in_progress() const;
     float progress() const;
+    void wait();
+    bool wait_for(std::chrono::milliseconds timeout);
     std::pair<float, float> completion_time() const;
+    /// Counts and timings of the current render; times are filled in once it finishes
+    Ray_Stats stats() const;
 
 private:
     // Internal
-    void build_scene(Scene& scene);
-    void build_lights(Scene& scene, std::vector<Object>& objs);
-    void do_trace(size_t samples);
-    void accumulate(const HDR_Image& sample);
+    // Stages that read the layout scene finish before read; the scene is built after done
+    struct Scene_Build;
+    struct Build_Stages {
+        Task_Graph::Node read, done;
+    };
+    Build_Stages build_scene(Scene& scene, Scene_Build& build, Task_Graph& graph) const;
+    void build_lights(Scene& scene, Scene_Build& build, size_t slot) const;
+    void use_scene(Scene_Data&& data);
+    void reset_output();
+    void start_render(const Camera& cam, bool add_samples);
+    void do_trace(size_t samples, size_t epoch);
+    void enqueue_epoch(size_t samples);
+    void enqueue_epochs(size_t samples);
+    size_t count_epochs(size_t samples) const;
+    void enqueue_guide_pass(size_t pass);
+    void finish_guide_pass(size_t pass);
+    void finish_epoch();
+    bool out_of_time() const;
+    void accumulate(const HDR_Image& sample, const AOV_Buffers& sample_aovs, size_t samples);
+    bool denoised_ready();
     bool tonemap();
 
     Gui::Widget_Render& gui;
     unsigned long long render_time, build_time;
-    Thread_Pool thread_pool;
+    Thread_Pool& thread_pool;
+    Task_Group render_tasks;
+
+    // The build of the current render, which starts tracing once it finishes
+    std::optional<Task_Graph> build_graph;
+    std::atomic<bool> building;
     bool cancel_flag = false;
 
     HDR_Image accumulator;
     std::mutex accumulator_mut;
-    size_t total_epochs, accumulator_samples;
-    std::atomic<size_t> completed_epochs;
+
+    // First-hit data gathered alongside the accumulator. The denoiser reads the
+    // albedo and normal buffers, so denoising always captures those two.
+    bool aov_enabled[(int)AOV::count] = {};
+    bool capture_aovs = false;
+    AOV_Buffers aovs;
+
+    bool denoise = false, denoised_dirty = true;
+    HDR_Image denoised;
+    std::atomic<size_t> total_epochs, completed_epochs, accumulator_samples;
+
+    // Epochs are numbered as they are issued, which fixes their seeds
+    unsigned int seed = 0;
+    std::atomic<size_t> issued_epochs;
+
+    Ray_Stats ray_stats;
+    mutable std::mutex stats_mut;
+
+    Ray_Log ray_log;
+
+    // Signalled when the last epoch of a render completes (or the render is cancelled)
+    std::mutex epoch_mut;
+    std::condition_variable epoch_cond;
+
+    // If non-zero, epochs are re-issued until this many seconds have passed
+    float time_budget = 0.0f;
+    unsigned long long deadline = 0;
 
     /// Relevant to student
-    Spectrum trace_pixel(size_t x, size_t y);
-    Spectrum trace_ray(const Ray& ray);
+    Vec2 sample_pixel(size_t x, size_t y);
+    Spectrum trace_ray(const Ray& ray, const Path& path);
     void log_ray(const Ray& ray, float t, Spectrum color = Spectrum{1.0f});
+    void record_hit(const Path& path, const Trace& hit, const BSDF& bsdf);
+    size_t split_paths(const Path& path, float& weight) const;
+    bool roulette(size_t depth, Spectrum& beta) const;
+    float mis_weight(float n_f, float pdf_f, float n_g, float pdf_g) const;
+    float emission_weight(const Path& path, float pdf) const;
+    float light_pdf(const Ray& ray, int material) const;
+    BSDF_Sample sample_scatter(const BSDF& bsdf, Vec3 pos, Vec3 out_dir,
+                               const Frame& frame) const;
+    float scatter_pdf(const BSDF& bsdf, Vec3 pos, Vec3 out_dir, Vec3 in_dir,
+                      const Frame& frame) const;
+    void record_guide(Vec3 pos, Vec3 dir, Spectrum radiance, Spectrum beta, float pdf);
 
     BVH<Object> scene;
     std::vector<Light> lights;
     std::vector<BSDF> materials;
     std::optional<Env_Light> env_light; // only one of these per scene
-    std::unordered_map<Scene_ID, size_t> mat_cache;
+    std::unordered_map<size_t, size_t> emitter_light; // material index -> area light index
 
     Camera camera;
     size_t out_w, out_h, n_samples, n_area_samples, max_depth;
+
+    Roulette_Policy roulette_policy = Roulette_Policy::throughput;
+    size_t roulette_depth = 2;
+    MIS_Mode mis_mode = MIS_Mode::none;
+
+    // Path guiding: the first half of the samples are traced in passes of
+    // doubling size, each learning from the last. The rest use the final guide.
+    bool guiding = false, guide_training = false;
+    SD_Tree guide;
+    size_t guide_passes = 0;
+    std::atomic<size_t> guide_pending;
 };
 
 } // namespace PT
@@ -0,0 +1,113 @@
+#include <algorithm>
+
+#include "ray_log.h"
+
+namespace PT {
+
+thread_local Ray_Log::Cached Ray_Log::cached;
+
+// Distinguishes logs in the thread caches, even one created where another was destroyed
+static std::atomic<size_t> next_log_id{1};
+
+Ray_Log::Ray_Log() : id(next_log_id++), every(0), generation(1) {
+}
+
+Ray_Log::~Ray_Log() {
+    if(cached.log == id) cached = {};
+}
+
+void Ray_Log::set(size_t e, size_t c) {
+    every.store(e, std::memory_order_relaxed);
+    c = std::max(c, size_t(1));
+    if(c == cap) return;
+
+    std::lock_guard<std::mutex> lock(rings_mut);
+    cap = c;
+    generation++;
+    merged.clear();
+    merged_next = 0;
+}
+
+Ray_Log::Ring* Ray_Log::ring() {
+
+    size_t gen = generation.load(std::memory_order_acquire);
+    if(cached.log == id && cached.generation == gen) return cached.ring;
+
+    std::lock_guard<std::mutex> lock(rings_mut);
+    gen = generation.load();
+    std::thread::id self = std::this_thread::get_id();
+
+    Ring* found = nullptr;
+    for(auto& r : rings) {
+        if(r->thread == self && r->generation == gen) found = r.get();
+    }
+    if(!found) {
+        auto r = std::make_unique<Ring>();
+        r->thread = self;
+        r->generation = gen;
+        r->slots.resize(cap);
+        found = r.get();
+        rings.push_back(std::move(r));
+    }
+    cached = {id, gen, found};
+    return found;
+}
+
+void Ray_Log::add(Vec3 start, Vec3 end, Spectrum color) {
+
+    size_t n = every.load(std::memory_order_relaxed);
+    if(!n) return;
+
+    Ring* r = ring();
+    if(++r->skipped < n) return;
+    r->skipped = 0;
+
+    size_t head = r->head.load(std::memory_order_relaxed);
+    if(head - r->tail.load(std::memory_order_acquire) >= r->slots.size()) return;
+    r->slots[head % r->slots.size()] = {start, end, color};
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+bool Ray_Log::collect() {
+
+    bool added = false;
+    std::lock_guard<std::mutex> lock(rings_mut);
+    for(auto& r : rings) {
+        size_t head = r->head.load(std::memory_order_acquire);
+        size_t tail = r->tail.load(std::memory_order_relaxed);
+        for(size_t i = tail; i < head; i++) {
+            const Line& line = r->slots[i % r->slots.size()];
+            if(merged.size() < cap) {
+                merged.push_back(line);
+            } else {
+                merged[merged_next] = line;
+                merged_next = (merged_next + 1) % cap;
+            }
+        }
+        r->tail.store(head, std::memory_order_release);
+        added = added || head != tail;
+    }
+    return added;
+}
+
+const std::vector<Ray_Log::Line>& Ray_Log::lines() const {
+    return merged;
+}
+
+void Ray_Log::clear() {
+
+    // Rings from before the last change of cap are no longer written to
+    std::lock_guard<std::mutex> lock(rings_mut);
+    size_t gen = generation.load();
+    rings.erase(std::remove_if(rings.begin(), rings.end(),
+                               [gen](const auto& r) { return r->generation != gen; }),
+                rings.end());
+    for(auto& r : rings) {
+        r->tail.store(r->head.load());
+        r->skipped = 0;
+    }
+    merged.clear();
+    merged_next = 0;
+}
+
+} // namespace PT
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../lib/mathlib.h"
+#include "../lib/spectrum.h"
+
+namespace PT {
+
+// Rays logged by the tracing threads for the debug view. Each thread keeps one in
+// every few rays in its own fixed-size ring, which it fills without locking; the
+// GUI thread empties the rings into a merged log of the latest rays only when it
+// draws. A full ring drops new rays until it is emptied, so logging costs a
+// bounded amount per ray, and a single check when it is off.
+class Ray_Log {
+public:
+    struct Line {
+        Vec3 start, end;
+        Spectrum color;
+    };
+
+    Ray_Log();
+    ~Ray_Log();
+
+    Ray_Log(const Ray_Log&) = delete;
+    Ray_Log& operator=(const Ray_Log&) = delete;
+
+    /// Keep one in every `every` rays and at most cap of them; every = 0 turns logging off.
+    /// Called from the collecting thread.
+    void set(size_t every, size_t cap);
+    bool enabled() const {
+        return every.load(std::memory_order_relaxed) > 0;
+    }
+
+    /// Called by the tracing threads
+    void add(Vec3 start, Vec3 end, Spectrum color);
+
+    /// Move rays logged since the last call into the merged log; true if any were.
+    /// Only one thread may collect at a time.
+    bool collect();
+    /// The merged log, in no particular order
+    const std::vector<Line>& lines() const;
+
+    /// Drop every logged ray; nothing may be tracing
+    void clear();
+
+private:
+    // Written only by its thread (head) and the collecting thread (tail)
+    struct Ring {
+        std::thread::id thread;
+        size_t generation = 0;
+        std::vector<Line> slots;
+        std::atomic<size_t> head{0}, tail{0};
+        size_t skipped = 0;
+    };
+
+    // The ring this thread last logged to, checked before searching the list
+    struct Cached {
+        size_t log = 0, generation = 0;
+        Ring* ring = nullptr;
+    };
+    static thread_local Cached cached;
+
+    Ring* ring();
+
+    // Changing the cap starts a new generation of rings; threads notice on their next ray
+    size_t id;
+    std::atomic<size_t> every, generation;
+    size_t cap = 0;
+
+    std::mutex rings_mut;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    std::vector<Line> merged;
+    size_t merged_next = 0;
+};
+
+} // namespace PT
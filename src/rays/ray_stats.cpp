@@ -0,0 +1,67 @@
+#include <sstream>
+
+#include "ray_stats.h"
+
+namespace PT {
+
+thread_local Ray_Stats* Ray_Stats::local = nullptr;
+
+void Ray_Stats::merge(const Ray_Stats& other) {
+    camera_rays += other.camera_rays;
+    shadow_rays += other.shadow_rays;
+    bounce_rays += other.bounce_rays;
+    nodes_visited += other.nodes_visited;
+    primitive_tests += other.primitive_tests;
+    roulette_kills += other.roulette_kills;
+    for(size_t i = 0; i < path_bins; i++) path_lengths[i] += other.path_lengths[i];
+    build_time += other.build_time;
+    render_time += other.render_time;
+    trace_time += other.trace_time;
+    accumulate_time += other.accumulate_time;
+}
+
+std::string Ray_Stats::to_json() const {
+
+    std::stringstream out;
+    out << "{\n";
+    out << "  \"build_time\": " << build_time << ",\n";
+    out << "  \"render_time\": " << render_time << ",\n";
+    out << "  \"trace_time\": " << trace_time << ",\n";
+    out << "  \"accumulate_time\": " << accumulate_time << ",\n";
+    out << "  \"camera_rays\": " << camera_rays << ",\n";
+    out << "  \"shadow_rays\": " << shadow_rays << ",\n";
+    out << "  \"bounce_rays\": " << bounce_rays << ",\n";
+    out << "  \"counters\": " << (enabled ? "true" : "false");
+    if(enabled) {
+        out << ",\n";
+        out << "  \"nodes_visited\": " << nodes_visited << ",\n";
+        out << "  \"primitive_tests\": " << primitive_tests << ",\n";
+        out << "  \"roulette_kills\": " << roulette_kills << ",\n";
+
+        // Trailing empty bins are left out
+        size_t n = path_bins;
+        while(n > 0 && path_lengths[n - 1] == 0) n--;
+        out << "  \"path_lengths\": [";
+        for(size_t i = 0; i < n; i++) out << (i ? ", " : "") << path_lengths[i];
+        out << "]";
+    }
+    out << "\n}\n";
+    return out.str();
+}
+
+Collect_Stats::Collect_Stats(Ray_Stats& total, std::mutex& mut, double Ray_Stats::*timer)
+    : outer(Ray_Stats::local), total(total), mut(mut), timer(timer),
+      start(std::chrono::steady_clock::now()) {
+    Ray_Stats::local = &stats;
+}
+
+Collect_Stats::~Collect_Stats() {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.*timer += elapsed.count();
+    Ray_Stats::local = outer;
+
+    std::lock_guard<std::mutex> lock(mut);
+    total.merge(stats);
+}
+
+} // namespace PT
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace PT {
+
+// Where a render spends its rays and its time. The traversal counters are only
+// compiled in when CARDINAL3D_RAY_STATS is defined (see CMakeLists.txt). The
+// camera, shadow and bounce ray counts and the timings are deliberately kept in
+// every build: they cost a few increments per path, and the benchmark's rays
+// per second needs them. Each tracing thread counts into its own copy, which is
+// added to the render's totals when the thread finishes its share of the work.
+struct Ray_Stats {
+
+#ifdef CARDINAL3D_RAY_STATS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    /// Paths are binned by the depth of their last ray; the last bin holds the rest
+    static const size_t path_bins = 32;
+
+    size_t camera_rays = 0, shadow_rays = 0, bounce_rays = 0;
+    size_t nodes_visited = 0, primitive_tests = 0, roulette_kills = 0;
+    size_t path_lengths[path_bins] = {};
+
+    /// Wall-clock seconds
+    double build_time = 0.0, render_time = 0.0;
+    /// Seconds summed over every thread
+    double trace_time = 0.0, accumulate_time = 0.0;
+
+    void merge(const Ray_Stats& other);
+    std::string to_json() const;
+
+    size_t rays() const {
+        return camera_rays + shadow_rays + bounce_rays;
+    }
+
+    /// Always counted; for camera_rays, shadow_rays and bounce_rays
+    static void count_ray(size_t Ray_Stats::*counter) {
+        if(local) (local->*counter)++;
+    }
+    /// Only counted with CARDINAL3D_RAY_STATS
+    static void count(size_t Ray_Stats::*counter) {
+#ifdef CARDINAL3D_RAY_STATS
+        if(local) (local->*counter)++;
+#endif
+    }
+    static void count_path(size_t depth) {
+#ifdef CARDINAL3D_RAY_STATS
+        if(local) local->path_lengths[depth < path_bins ? depth : path_bins - 1]++;
+#endif
+    }
+
+private:
+    static thread_local Ray_Stats* local;
+    friend class Collect_Stats;
+};
+
+// Counts on the calling thread and times the scope, then adds both to total
+class Collect_Stats {
+public:
+    Collect_Stats(Ray_Stats& total, std::mutex& mut, double Ray_Stats::*timer);
+    ~Collect_Stats();
+
+private:
+    Ray_Stats stats;
+    Ray_Stats* outer;
+    Ray_Stats& total;
+    std::mutex& mut;
+    double Ray_Stats::*timer;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace PT
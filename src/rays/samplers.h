@@ -45,11 +45,13 @@ namespace Hemisphere {
 struct Uniform {
     Uniform() = default;
     Vec3 sample(float& pdf) const;
+    float pdf(Vec3 dir) const;
 };
 
 struct Cosine {
     Cosine() = default;
     Vec3 sample(float& pdf) const;
+    float pdf(Vec3 dir) const;
 };
 } // namespace Hemisphere
 
@@ -58,6 +60,7 @@ namespace Sphere {
 struct Uniform {
     Uniform() = default;
     Vec3 sample(float& pdf) const;
+    float pdf(Vec3 dir) const;
     Hemisphere::Uniform hemi;
 };
 
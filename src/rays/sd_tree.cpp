@@ -0,0 +1,285 @@
+
+#include "sd_tree.h"
+#include "../util/rand.h"
+
+namespace PT {
+
+static void atomic_add(std::atomic<float>& dst, float value) {
+    float cur = dst.load(std::memory_order_relaxed);
+    while(!dst.compare_exchange_weak(cur, cur + value, std::memory_order_relaxed)) {
+    }
+}
+
+D_Tree::Node::Node() {
+    for(int i = 0; i < 4; i++) {
+        sum[i] = 0.0f;
+        child[i] = 0;
+    }
+}
+
+D_Tree::Node::Node(const Node& src) {
+    *this = src;
+}
+
+D_Tree::Node& D_Tree::Node::operator=(const Node& src) {
+    for(int i = 0; i < 4; i++) {
+        sum[i] = src.sum[i].load(std::memory_order_relaxed);
+        child[i] = src.child[i];
+    }
+    return *this;
+}
+
+float D_Tree::Node::total() const {
+    float t = 0.0f;
+    for(int i = 0; i < 4; i++) t += sum[i].load(std::memory_order_relaxed);
+    return t;
+}
+
+D_Tree::D_Tree() : nodes(1) {
+}
+
+Vec2 D_Tree::to_square(Vec3 dir) {
+    float phi = std::atan2(dir.z, dir.x) / (2.0f * PI_F);
+    if(phi < 0.0f) phi += 1.0f;
+    return Vec2(clamp((dir.y + 1.0f) * 0.5f, 0.0f, 1.0f), clamp(phi, 0.0f, 1.0f));
+}
+
+Vec3 D_Tree::from_square(Vec2 p) {
+    float y = 2.0f * p.x - 1.0f;
+    float r = std::sqrt(std::max(0.0f, 1.0f - y * y));
+    float phi = 2.0f * PI_F * p.y;
+    return Vec3(r * std::cos(phi), y, r * std::sin(phi));
+}
+
+int D_Tree::quadrant(Vec2& p) {
+    int qx = p.x >= 0.5f ? 1 : 0;
+    int qy = p.y >= 0.5f ? 1 : 0;
+    p = Vec2(p.x * 2.0f - qx, p.y * 2.0f - qy);
+    return qx + 2 * qy;
+}
+
+void D_Tree::record(Vec3 dir, float value) {
+    if(!std::isfinite(value) || value <= 0.0f) return;
+
+    Vec2 p = to_square(dir);
+    unsigned int node = 0;
+    for(;;) {
+        int q = quadrant(p);
+        if(!nodes[node].child[q]) {
+            atomic_add(nodes[node].sum[q], value);
+            return;
+        }
+        node = nodes[node].child[q];
+    }
+}
+
+Vec3 D_Tree::sample(float& pdf) const {
+
+    Vec2 origin;
+    float scale = 1.0f;
+    float density = 1.0f;
+    unsigned int node = 0;
+
+    for(;;) {
+        const Node& n = nodes[node];
+        float t = n.total();
+        if(t <= 0.0f) break;
+
+        // Pick a quadrant proportionally to its energy
+        float r = RNG::unit() * t;
+        int q = 0;
+        for(; q < 3; q++) {
+            float s = n.sum[q].load(std::memory_order_relaxed);
+            if(r < s) break;
+            r -= s;
+        }
+        while(n.sum[q].load(std::memory_order_relaxed) <= 0.0f) q--;
+
+        density *= 4.0f * n.sum[q].load(std::memory_order_relaxed) / t;
+        scale *= 0.5f;
+        origin += Vec2((float)(q & 1), (float)(q >> 1)) * scale;
+        if(!n.child[q]) break;
+        node = n.child[q];
+    }
+
+    pdf = density / (4.0f * PI_F);
+    return from_square(origin + Vec2(RNG::unit(), RNG::unit()) * scale);
+}
+
+float D_Tree::pdf(Vec3 dir) const {
+
+    Vec2 p = to_square(dir);
+    float density = 1.0f;
+    unsigned int node = 0;
+
+    for(;;) {
+        const Node& n = nodes[node];
+        float t = n.total();
+        if(t <= 0.0f) break;
+
+        int q = quadrant(p);
+        float s = n.sum[q].load(std::memory_order_relaxed);
+        if(s <= 0.0f) return 0.0f;
+
+        density *= 4.0f * s / t;
+        if(!n.child[q]) break;
+        node = n.child[q];
+    }
+
+    return density / (4.0f * PI_F);
+}
+
+void D_Tree::build() {
+
+    // Children are always stored after their parents
+    for(size_t i = nodes.size(); i-- > 0;) {
+        Node& n = nodes[i];
+        for(int q = 0; q < 4; q++) {
+            if(n.child[q]) n.sum[q] = nodes[n.child[q]].total();
+        }
+    }
+    energy = nodes[0].total();
+}
+
+void D_Tree::refine(const D_Tree& from, float threshold, size_t max_depth) {
+
+    energy = 0.0f;
+
+    if(from.total() <= 0.0f) {
+        // Nothing to go on: keep the old structure
+        nodes = from.nodes;
+        for(Node& n : nodes) {
+            for(int q = 0; q < 4; q++) n.sum[q] = 0.0f;
+        }
+        return;
+    }
+
+    nodes.clear();
+    nodes.emplace_back();
+
+    // Regions that were leaves in the old tree have their energy spread
+    // evenly among any new children.
+    struct Entry {
+        unsigned int node;
+        int from;
+        size_t depth;
+        float energy;
+    };
+    std::vector<Entry> stack;
+    stack.push_back({0, 0, 1, from.total()});
+
+    while(!stack.empty()) {
+        Entry e = stack.back();
+        stack.pop_back();
+
+        for(int q = 0; q < 4; q++) {
+            int from_child = -1;
+            float e_q = e.energy / 4.0f;
+            if(e.from >= 0) {
+                const Node& old = from.nodes[e.from];
+                e_q = old.sum[q].load(std::memory_order_relaxed);
+                if(old.child[q]) from_child = (int)old.child[q];
+            }
+
+            if(e.depth < max_depth && e_q / from.total() > threshold) {
+                unsigned int idx = (unsigned int)nodes.size();
+                nodes[e.node].child[q] = idx;
+                nodes.emplace_back();
+                stack.push_back({idx, from_child, e.depth + 1, e_q});
+            }
+        }
+    }
+}
+
+void SD_Tree::reset(BBox box) {
+    nodes.clear();
+    leaves.clear();
+
+    Node root;
+    root.box = box;
+    nodes.push_back(root);
+    leaves.push_back(std::make_unique<Leaf>());
+}
+
+unsigned int SD_Tree::find(Vec3 pos) const {
+    unsigned int node = 0;
+    while(nodes[node].child[0]) {
+        const Node& n = nodes[node];
+        float split = 0.5f * (n.box.min[n.axis] + n.box.max[n.axis]);
+        node = pos[n.axis] < split ? n.child[0] : n.child[1];
+    }
+    return nodes[node].leaf;
+}
+
+const D_Tree* SD_Tree::sampler(Vec3 pos) const {
+    if(nodes.empty()) return nullptr;
+    const D_Tree& tree = leaves[find(pos)]->sampling;
+    return tree.total() > 0.0f ? &tree : nullptr;
+}
+
+void SD_Tree::record(Vec3 pos, Vec3 dir, float value) {
+    if(nodes.empty()) return;
+    Leaf& leaf = *leaves[find(pos)];
+    leaf.building.record(dir, value);
+    leaf.records++;
+}
+
+void SD_Tree::refine(size_t threshold) {
+
+    static const float energy_threshold = 0.01f;
+    static const size_t max_depth = 20;
+
+    if(nodes.empty()) return;
+
+    // Split busy regions in half along alternating axes. Both halves start
+    // from a copy of the parent's records.
+    std::vector<unsigned int> stack;
+    stack.push_back(0);
+    while(!stack.empty()) {
+        unsigned int idx = stack.back();
+        stack.pop_back();
+
+        if(nodes[idx].child[0]) {
+            stack.push_back(nodes[idx].child[0]);
+            stack.push_back(nodes[idx].child[1]);
+            continue;
+        }
+
+        Leaf& leaf = *leaves[nodes[idx].leaf];
+        if(leaf.records.load() <= threshold) continue;
+
+        size_t half = leaf.records.load() / 2;
+        leaf.records = half;
+        auto copy = std::make_unique<Leaf>();
+        copy->building = leaf.building;
+        copy->records = half;
+
+        Node left, right;
+        left.axis = right.axis = (nodes[idx].axis + 1) % 3;
+        left.box = right.box = nodes[idx].box;
+        int axis = nodes[idx].axis;
+        float split = 0.5f * (nodes[idx].box.min[axis] + nodes[idx].box.max[axis]);
+        left.box.max[axis] = split;
+        right.box.min[axis] = split;
+        left.leaf = nodes[idx].leaf;
+        right.leaf = (unsigned int)leaves.size();
+        leaves.push_back(std::move(copy));
+
+        unsigned int l = (unsigned int)nodes.size();
+        nodes.push_back(left);
+        nodes.push_back(right);
+        nodes[idx].child[0] = l;
+        nodes[idx].child[1] = l + 1;
+        stack.push_back(l);
+        stack.push_back(l + 1);
+    }
+
+    for(auto& leaf : leaves) {
+        leaf->building.build();
+        leaf->sampling = leaf->building;
+        leaf->building.refine(leaf->sampling, energy_threshold, max_depth);
+        leaf->records = 0;
+    }
+}
+
+} // namespace PT
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "../lib/mathlib.h"
+
+namespace PT {
+
+// Directional quadtree over the sphere of directions. Directions are mapped
+// to the unit square with the cylindrical equal-area projection, so a density
+// over the square is a density over solid angle up to a factor of 4pi.
+class D_Tree {
+public:
+    D_Tree();
+
+    /// Add a radiance estimate arriving from dir (may be called concurrently)
+    void record(Vec3 dir, float value);
+
+    /// Sample a direction proportionally to the recorded radiance
+    Vec3 sample(float& pdf) const;
+    /// Solid angle density with which sample() returns dir
+    float pdf(Vec3 dir) const;
+    /// Total recorded energy (valid after build())
+    float total() const {
+        return energy;
+    }
+
+    /// Propagate recorded energy from the leaves up to the root
+    void build();
+    /// Rebuild this tree's structure from the energy in from and clear all records.
+    /// Quadrants holding more than threshold of the total energy are subdivided.
+    void refine(const D_Tree& from, float threshold, size_t max_depth);
+
+    static Vec2 to_square(Vec3 dir);
+    static Vec3 from_square(Vec2 p);
+
+private:
+    struct Node {
+        Node();
+        Node(const Node& src);
+        Node& operator=(const Node& src);
+
+        float total() const;
+
+        std::atomic<float> sum[4];
+        // Index of the node subdividing each quadrant, or 0 if the quadrant is a leaf
+        unsigned int child[4];
+    };
+
+    static int quadrant(Vec2& p);
+
+    std::vector<Node> nodes;
+    float energy = 0.0f;
+};
+
+// Binary tree over the scene bounds whose leaves each hold a directional
+// quadtree of incident radiance. One copy of each quadtree is used for
+// sampling while the other collects records for the next iteration.
+class SD_Tree {
+public:
+    void reset(BBox box);
+
+    /// Sampling distribution for the region containing pos, or nullptr if
+    /// nothing has been learned there yet
+    const D_Tree* sampler(Vec3 pos) const;
+    /// Record radiance arriving at pos from dir (may be called concurrently)
+    void record(Vec3 pos, Vec3 dir, float value);
+
+    /// Start a new iteration: split regions with more than threshold records,
+    /// then make the collected records the new sampling distributions.
+    void refine(size_t threshold);
+
+private:
+    struct Node {
+        BBox box;
+        int axis = 0;
+        // Children of an interior node; leaf index otherwise
+        unsigned int child[2] = {0, 0};
+        unsigned int leaf = 0;
+    };
+
+    struct Leaf {
+        D_Tree sampling, building;
+        std::atomic<size_t> records{0};
+    };
+
+    unsigned int find(Vec3 pos) const;
+
+    std::vector<Node> nodes;
+    std::vector<std::unique_ptr<Leaf>> leaves;
+};
+
+} // namespace PT
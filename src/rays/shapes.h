@@ -41,7 +41,7 @@ public:
         return std::visit(overloaded{[](const auto& o) { return o.bbox(); }}, underlying);
     }
 
-    Trace hit(Ray ray) const {
+    Trace hit(const Ray& ray) const {
         return std::visit(overloaded{[&ray](const auto& o) { return o.hit(ray); }}, underlying);
     }
 
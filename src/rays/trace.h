@@ -11,6 +11,7 @@ struct Trace {
     float distance = 0.0f;
     Vec3 position, normal, origin;
     int material = 0;
+    unsigned int id = 0; // Scene_ID of the object hit
 
     static Trace min(const Trace& l, const Trace& r) {
         if(l.hit && r.hit) {
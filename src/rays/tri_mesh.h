@@ -35,6 +35,7 @@ class Tri_Mesh {
 public:
     Tri_Mesh() = default;
     Tri_Mesh(const GL::Mesh& mesh);
+    Tri_Mesh(const std::vector<GL::Mesh::Vert>& verts, const std::vector<GL::Mesh::Index>& idxs);
 
     Tri_Mesh(Tri_Mesh&& src) = default;
     Tri_Mesh& operator=(Tri_Mesh&& src) = default;
@@ -49,6 +50,9 @@ public:
     size_t visualize(GL::Lines& lines, GL::Lines& active, size_t level, const Mat4& trans) const;
 
     void build(const GL::Mesh& mesh);
+    /// Same as above, from a copy of the mesh's data, so it can run away from the GL thread
+    void build(const std::vector<GL::Mesh::Vert>& mesh_verts,
+               const std::vector<GL::Mesh::Index>& idxs);
 
 private:
     std::vector<Tri_Mesh_Vert> verts;
@@ -8,6 +8,7 @@
 #include "../gui/manager.h"
 #include "../gui/render.h"
 #include "../lib/log.h"
+#include "../util/profiler.h"
 
 #include "renderer.h"
 #include "scene.h"
@@ -701,6 +702,7 @@ static unsigned int load_flags(Scene::Load_Opts opt) {
 
 std::string Scene::load(Scene::Load_Opts loader, Undo& undo, Gui::Manager& gui, std::string file) {
 
+    Profiler::Zone zone("Scene load");
     if(loader.new_scene) {
         clear(undo);
         gui.get_animate().clear();
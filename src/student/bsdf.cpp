@@ -67,6 +67,11 @@ Spectrum BSDF_Lambertian::evaluate(Vec3 out_dir, Vec3 in_dir) const {
     return albedo * (1.0f / PI_F);
 }
 
+float BSDF_Lambertian::pdf(Vec3 out_dir, Vec3 in_dir) const {
+    // Must match the distribution BSDF_Lambertian::sample draws from
+    return sampler.pdf(in_dir);
+}
+
 BSDF_Sample BSDF_Mirror::sample(Vec3 out_dir) const {
 
     // TODO (PathTracer): Task 6
@@ -88,6 +93,11 @@ Spectrum BSDF_Mirror::evaluate(Vec3 out_dir, Vec3 in_dir) const {
     return {};
 }
 
+float BSDF_Mirror::pdf(Vec3 out_dir, Vec3 in_dir) const {
+    // Likewise, a delta distribution has zero density in every other direction.
+    return 0.0f;
+}
+
 BSDF_Sample BSDF_Glass::sample(Vec3 out_dir) const {
 
     // TODO (PathTracer): Task 6
@@ -112,6 +122,10 @@ Spectrum BSDF_Glass::evaluate(Vec3 out_dir, Vec3 in_dir) const {
     return {};
 }
 
+float BSDF_Glass::pdf(Vec3 out_dir, Vec3 in_dir) const {
+    return 0.0f;
+}
+
 BSDF_Sample BSDF_Diffuse::sample(Vec3 out_dir) const {
     BSDF_Sample ret;
     ret.direction = sampler.sample(ret.pdf);
@@ -125,6 +139,10 @@ Spectrum BSDF_Diffuse::evaluate(Vec3 out_dir, Vec3 in_dir) const {
     return {};
 }
 
+float BSDF_Diffuse::pdf(Vec3 out_dir, Vec3 in_dir) const {
+    return sampler.pdf(in_dir);
+}
+
 BSDF_Sample BSDF_Refract::sample(Vec3 out_dir) const {
 
     // TODO (PathTracer): Task 6
@@ -145,4 +163,8 @@ Spectrum BSDF_Refract::evaluate(Vec3 out_dir, Vec3 in_dir) const {
     return {};
 }
 
+float BSDF_Refract::pdf(Vec3 out_dir, Vec3 in_dir) const {
+    return 0.0f;
+}
+
 } // namespace PT
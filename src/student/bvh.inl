@@ -1,5 +1,6 @@
 
 #include "../rays/bvh.h"
+#include "../util/profiler.h"
 #include "debug.h"
 #include <stack>
 
@@ -30,11 +31,14 @@ void BVH<Primitive>::subdivide(size_t root_node_addr, Node& node, size_t max_lea
         float cmax = node.bbox.max[cind];
         float dC = (cmax - cmin) / (BUCKETS_COUNT-1);
 
+        // A flat box can't be split along this axis
+        if(!(dC > 0.0f)) continue;
+
         // Assign primitives to buckets
         for(auto itPrim = node.start; itPrim < (size_t)(node.start + node.size); ++itPrim) {
             const BBox& bbox = primitives[itPrim].bbox();
             Vec3 c = 0.5f * (bbox.min + bbox.max);
-            float bNo = (int)((c[cind] - cmin) / dC);
+            int bNo = std::clamp((int)((c[cind] - cmin) / dC), 0, BUCKETS_COUNT - 1);
             bboxes[bNo].enclose(bbox);
             buckets[bNo]++;
         }
@@ -87,6 +91,11 @@ void BVH<Primitive>::subdivide(size_t root_node_addr, Node& node, size_t max_lea
         }
     }
 
+    // Every primitive landed in the same bucket, so keep them in one leaf
+    if(dimMin < 0) {
+        return;
+    }
+
     std::vector<int> buckets;
 
     buckets.resize(BUCKETS_COUNT, 0);
@@ -164,6 +173,8 @@ void BVH<Primitive>::build(std::vector<Primitive>&& prims, size_t max_leaf_size)
     //      Trace hit(const Ray& ray) const;
     // Hence, you may call bbox() and hit() on any value of type Primitive.
 
+    Profiler::Zone zone("BVH build");
+
     // Keep these two lines of code in your solution. They clear the list of nodes and
     // initialize member variable 'primitives' as a vector of the scene prims
     nodes.clear();
@@ -223,38 +234,43 @@ void BVH<Primitive>::build(std::vector<Primitive>&& prims, size_t max_leaf_size)
 }
 
 template<typename Primitive>
-void BVH<Primitive>::find_closest_hit(const Ray& ray,const Node& node, Trace& closest) const {
+void BVH<Primitive>::find_closest_hit(const Ray& ray, const Ray_Box& box_ray, const Node& node,
+                                      Trace& closest) const {
+    Ray_Stats::count(&Ray_Stats::nodes_visited);
     if(node.is_leaf()) {
         for(PrimitivesCIterator itPrim = primitives.begin() + node.start;
             itPrim != primitives.begin() + node.start + node.size; itPrim++) {
+            Ray_Stats::count(&Ray_Stats::primitive_tests);
             Trace hit = itPrim->hit(ray);
             closest = Trace::min(closest, hit);
         }
     } else {
+        // Boxes past the closest hit so far can't contain anything closer
+        float limit = ray.dist_bounds.y;
+        if(closest.hit) limit = std::min(limit, closest.distance);
         const Node& cl = nodes[node.l];
         const Node& cr = nodes[node.r];
-        Vec2 hit[2];
-        bool hl = cl.bbox.hit(ray, hit[0]);
-        bool hr = cr.bbox.hit(ray, hit[1]);
+        Vec2 hit[2] = {Vec2(ray.dist_bounds.x, limit), Vec2(ray.dist_bounds.x, limit)};
+        bool hl = cl.bbox.hit(box_ray, hit[0]);
+        bool hr = cr.bbox.hit(box_ray, hit[1]);
         // Not hit any boxes
         if(!hl && !hr)
             return;
 
         // hit only one box
-        if((hl && !hr) || (!hl && hr)) {
-            find_closest_hit(ray, hl ? cl : cr ,closest);
+        if(hl != hr) {
+            find_closest_hit(ray, box_ray, hl ? cl : cr, closest);
             return;
         }
 
         // Hit two boxes, so we should check the closest first
-        size_t first = hit[0].x <= hit[1].x ? node.l : node.r;
-        size_t second = first == node.l ? node.r : node.l;
-        // size_t second_hit = second == node.l ? 0 : 1;
-
-        find_closest_hit(ray, nodes[first], closest);
-        // Trace c1 = closest;
-        //if(hit[second_hit].x < closest.distance)
-            find_closest_hit(ray, nodes[second], closest);
+        size_t first_hit = hit[0].x <= hit[1].x ? 0 : 1;
+        size_t first = first_hit == 0 ? node.l : node.r;
+        size_t second = first_hit == 0 ? node.r : node.l;
+
+        find_closest_hit(ray, box_ray, nodes[first], closest);
+        if(!closest.hit || hit[1 - first_hit].x <= closest.distance)
+            find_closest_hit(ray, box_ray, nodes[second], closest);
     }
 }
 
@@ -271,7 +287,11 @@ Trace BVH<Primitive>::hit(const Ray& ray) const {
     // Again, remember you can use hit() on any Primitive value.
 
     Trace ret;
-    find_closest_hit(ray, nodes[0], ret);
+    if(nodes.empty()) return ret;
+
+    Ray_Box box_ray(ray);
+    Vec2 times = ray.dist_bounds;
+    if(nodes[0].bbox.hit(box_ray, times)) find_closest_hit(ray, box_ray, nodes[0], ret);
     return ret;
 }
 
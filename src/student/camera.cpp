@@ -1,10 +1,9 @@
-
 #include "../util/camera.h"
 #include "../rays/samplers.h"
+#include "../util/rand.h"
 #include "debug.h"
+#include <algorithm>
 #include <iostream>
-#define _USE_MATH_DEFINES
-#include "math.h"
 
 Ray Camera::generate_ray(Vec2 screen_coord) const {
 
@@ -16,21 +15,85 @@ Ray Camera::generate_ray(Vec2 screen_coord) const {
     // located one unit away from the pinhole in camera space (aka view space).
     // You'll need to compute this position based on the vertial field of view
     // (vert_fov) of the camera, and the aspect ratio of the output image (aspect_ratio).
+    //
+    // The sensor plane is worked out in world space whenever the camera changes (see
+    // Camera::update_sensor), so a ray only needs a couple of multiply-adds.
+    Vec3 dir = sensor_corner + sensor_x * screen_coord.x + sensor_y * screen_coord.y;
+    if(aperture <= 0.0f) return Ray(position, dir.unit());
+
+    // Thin lens: start on a square lens and aim at the point on the focal plane the
+    // pinhole ray would have reached
+    Vec3 lens = lens_x * (RNG::unit() - 0.5f) + lens_y * (RNG::unit() - 0.5f);
+    return Ray(position + lens, (dir * focal_dist - lens).unit());
+}
+
+void Camera::generate_rays(const Vec2* screen_coords, size_t n, Camera_Rays& rays) const {
+
+    rays.resize(n);
+
+    // Origins start out as offsets on the lens, which are all zero for a pinhole
+    float focus = 1.0f;
+    if(aperture > 0.0f) {
+        focus = focal_dist;
+        for(size_t i = 0; i < n; i++) {
+            Vec3 lens = lens_x * (RNG::unit() - 0.5f) + lens_y * (RNG::unit() - 0.5f);
+            rays.ox[i] = lens.x;
+            rays.oy[i] = lens.y;
+            rays.oz[i] = lens.z;
+        }
+    } else {
+        std::fill(rays.ox.begin(), rays.ox.end(), 0.0f);
+        std::fill(rays.oy.begin(), rays.oy.end(), 0.0f);
+        std::fill(rays.oz.begin(), rays.oz.end(), 0.0f);
+    }
+
+    size_t i = 0;
 
-    // float horz_fov = vert_fov*aspect_ratio; // vert_fov is in deg 
-    float vert_len = tan(vert_fov * M_PI / 180.0f / 2.0f) * 2.0f; 
-    float horz_len = vert_len*aspect_ratio; 
+#ifdef CARDINAL3D_SSE
+    static_assert(sizeof(Vec2) == 2 * sizeof(float), "Vec2 must be two packed floats");
 
-    Vec3 pixel_coord((screen_coord.x-0.5f)*horz_len, (screen_coord.y-0.5f)*vert_len, -1.0f); // -0.5f because (0, 0) in screen is at (-0.5, -0.5)
+    // Four rays per step, one per lane
+    __m128 one = _mm_set1_ps(1.0f), f = _mm_set1_ps(focus);
+    for(; i + 4 <= n; i += 4) {
+        __m128 c01 = _mm_loadu_ps(&screen_coords[i].x);
+        __m128 c23 = _mm_loadu_ps(&screen_coords[i + 2].x);
+        __m128 x = _mm_shuffle_ps(c01, c23, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 y = _mm_shuffle_ps(c01, c23, _MM_SHUFFLE(3, 1, 3, 1));
 
-    // Tip: compute the ray direction in view space and use
-    // the camera space to world space transform (iview) to transform the ray back into world space.
-    Vec3 origin(0, 0, 0); // camera position is at origin
-    // Ray ray_world(iview.operator*(origin), iview.operator*(pixel_coord)); // ray in world space 
-    Ray ray(origin, pixel_coord.unit()); 
-    //Ray ray(origin, Vec3(0, 0, -1)); 
+        __m128 o[3] = {_mm_loadu_ps(&rays.ox[i]), _mm_loadu_ps(&rays.oy[i]),
+                       _mm_loadu_ps(&rays.oz[i])};
+        __m128 d[3];
+        for(int c = 0; c < 3; c++) {
+            __m128 s = _mm_add_ps(_mm_set1_ps(sensor_corner[c]),
+                                  _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(sensor_x[c])),
+                                             _mm_mul_ps(y, _mm_set1_ps(sensor_y[c]))));
+            d[c] = _mm_sub_ps(_mm_mul_ps(s, f), o[c]);
+            o[c] = _mm_add_ps(o[c], _mm_set1_ps(position[c]));
+        }
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])), _mm_mul_ps(d[2], d[2])));
+        __m128 inv = _mm_div_ps(one, len);
 
-    ray.transform(iview);
+        _mm_storeu_ps(&rays.ox[i], o[0]);
+        _mm_storeu_ps(&rays.oy[i], o[1]);
+        _mm_storeu_ps(&rays.oz[i], o[2]);
+        _mm_storeu_ps(&rays.dx[i], _mm_mul_ps(d[0], inv));
+        _mm_storeu_ps(&rays.dy[i], _mm_mul_ps(d[1], inv));
+        _mm_storeu_ps(&rays.dz[i], _mm_mul_ps(d[2], inv));
+    }
+#endif
 
-    return ray;
+    for(; i < n; i++) {
+        Vec2 s = screen_coords[i];
+        Vec3 lens(rays.ox[i], rays.oy[i], rays.oz[i]);
+        Vec3 dir = (sensor_corner + sensor_x * s.x + sensor_y * s.y) * focus - lens;
+        dir.normalize();
+        Vec3 origin = position + lens;
+        rays.ox[i] = origin.x;
+        rays.oy[i] = origin.y;
+        rays.oz[i] = origin.z;
+        rays.dx[i] = dir.x;
+        rays.dy[i] = dir.y;
+        rays.dz[i] = dir.z;
+    }
 }
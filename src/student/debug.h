@@ -38,7 +38,7 @@
 
     And we finally used the option in pathtracer.cpp:
 
-        Spectrum Pathtracer::trace_ray(const Ray& ray) {
+        Spectrum Pathtracer::trace_ray(const Ray& ray, const Path& path) {
 
             // ...
             Spectrum radiance_out = debug_data.normal_colors ? Spectrum(0.5f) :
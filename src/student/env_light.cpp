@@ -33,6 +33,15 @@ Spectrum Env_Map::sample_direction(Vec3 dir) const {
     return Spectrum();
 }
 
+float Env_Map::pdf(Vec3 dir) const {
+
+    // TODO (PathTracer): Task 7
+    // Return the density with which Env_Map::sample generates dir. This must
+    // match sample(), so update it once you switch to importance sampling.
+    Samplers::Sphere::Uniform uniform;
+    return uniform.pdf(dir);
+}
+
 Light_Sample Env_Hemisphere::sample() const {
     Light_Sample ret;
     ret.direction = sampler.sample(ret.pdf);
@@ -46,6 +55,10 @@ Spectrum Env_Hemisphere::sample_direction(Vec3 dir) const {
     return {};
 }
 
+float Env_Hemisphere::pdf(Vec3 dir) const {
+    return sampler.pdf(dir);
+}
+
 Light_Sample Env_Sphere::sample() const {
     Light_Sample ret;
     ret.direction = sampler.sample(ret.pdf);
@@ -58,4 +71,8 @@ Spectrum Env_Sphere::sample_direction(Vec3) const {
     return radiance;
 }
 
+float Env_Sphere::pdf(Vec3 dir) const {
+    return sampler.pdf(dir);
+}
+
 } // namespace PT
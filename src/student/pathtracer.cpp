@@ -7,17 +7,17 @@
 
 namespace PT {
 
-// Return the radiance along a ray entering the camera and landing on a
-// point within pixel (x,y) of the output image.
+// Return the normalized screen coordinate of a point within pixel (x,y) of the
+// output image, which the camera turns into the ray that lands there.
 //
 
-// Pathtracer::trace_pixel must support super-sampling. The starter code provided to you
-// will call Pathtracer::trace_pixel once for each sample (Pathtracer::n_samples) and
-// resolve the results to compute final pixel values.
-// Your implementation of Pathtracer::trace_pixel must choose a new location within the pixel for each sample.
+// Pathtracer::sample_pixel must support super-sampling. The starter code provided to you
+// will call Pathtracer::sample_pixel once for each sample (Pathtracer::n_samples), generate
+// the camera rays for a whole row at once, and resolve the results to compute final pixel values.
+// Your implementation of Pathtracer::sample_pixel must choose a new location within the pixel for each sample.
 // This is equivalent to saying that the ray tracer wil shoot n_samples camera rays per pixel.
 
-Spectrum Pathtracer::trace_pixel(size_t x, size_t y) {
+Vec2 Pathtracer::sample_pixel(size_t x, size_t y) {
 
     Vec2 xy((float)x, (float)y);
     Vec2 wh((float)out_w, (float)out_h);
@@ -50,49 +50,61 @@ Spectrum Pathtracer::trace_pixel(size_t x, size_t y) {
         //std::cout << pixel_norm << std::endl << std::endl;
 
     }
-    // As an example, the code below generates a ray through the bottom left of the
-    // specified pixel
-    Ray out = camera.generate_ray(pixel_norm);
-
     // Tip: you may want to use log_ray for debugging. Given ray t, the following lines
     // of code will log .03% of all rays (see util/rand.h) for visualization in the app.
     // see student/debug.h for more detail.
     //if (RNG::coin_flip(0.03f))
     // log_ray(out, 10.0f);
 
-    return trace_ray(out);
+    return pixel_norm;
 }
 
-Spectrum Pathtracer::trace_ray(const Ray& ray) {
+Spectrum Pathtracer::trace_ray(const Ray& ray, const Path& path) {
 
     
     // Lo += bsdf_s.emissive;
-    //  (1) Ray objects have a depth field; if it reaches max_depth, you should
+    //  (1) Paths have a depth field; if it reaches max_depth, you should
     //  terminate the path.
     // Trace ray into scene. If nothing is hit, sample the environment
     Trace hit = scene.hit(ray);
     if(!hit.hit) {
+        Ray_Stats::count_path(path.depth);
         if(env_light.has_value()) {
-            return env_light.value().sample_direction(ray.dir);
+            const Env_Light& env = env_light.value();
+            if(mis_mode != MIS_Mode::none) {
+                return path.beta * env.sample_direction(ray.dir) *
+                       emission_weight(path, env.pdf(ray.dir));
+            }
+            // Without MIS, light sampling already counted the environment after any
+            // non-discrete bounce; only camera and delta rays (pdf 0) may add it here.
+            if(path.pdf == 0.0f) return path.beta * env.sample_direction(ray.dir);
         }
         return {};
     }
-    log_ray(ray, hit.distance, ray.rcolor);
-    if(ray.depth == max_depth) {
-        return {};
+    log_ray(ray, hit.distance, path.rcolor);
+
+    // With MIS, emission found by BSDF sampling is kept at every bounce and
+    // weighted against the chance that light sampling would have found it too.
+    const BSDF& bsdf = materials[hit.material];
+    Spectrum Le;
+    if(mis_mode != MIS_Mode::none) {
+        Le = path.beta * bsdf.emissive() * emission_weight(path, light_pdf(ray, hit.material));
+    }
+    if(path.depth == max_depth) {
+        Ray_Stats::count_path(path.depth);
+        return Le;
     }
     // If we're using a two-sided material, treat back-faces the same as front-faces
-    const BSDF& bsdf = materials[hit.material];
     if(!bsdf.is_sided() && dot(hit.normal, ray.dir) > 0.0f) {
         hit.normal = -hit.normal;
     }
+    record_hit(path, hit, bsdf);
 
     // Set up a coordinate frame at the hit point, where the surface normal becomes {0, 1, 0}
     // This gives us out_dir and later in_dir in object space, where computations involving the
     // normal become much easier. For example, cos(theta) = dot(N,dir) = dir.y!
-    Mat4 object_to_world = Mat4::rotate_to(hit.normal);
-    Mat4 world_to_object = object_to_world.T();
-    Vec3 out_dir = world_to_object.rotate(ray.point - hit.position).unit();
+    Frame frame = Frame::from_y(hit.normal.unit());
+    Vec3 out_dir = frame.to_local(ray.point - hit.position).unit();
 
     // Debugging: if the normal colors flag is set, return the normal color
     if(debug_data.normal_colors) return Spectrum::direction(hit.normal);
@@ -120,7 +132,7 @@ Spectrum Pathtracer::trace_ray(const Ray& ray) {
                 // Grab a sample of the light source. See rays/light.h for definition of this struct.
                 // Most importantly for Task 4, it contains the distance to the light from hit.position.
                 Light_Sample sample = light.sample(hit.position);
-                Vec3 in_dir = world_to_object.rotate(sample.direction);
+                Vec3 in_dir = frame.to_local(sample.direction);
 
                 // If the light is below the horizon, ignore it
                 float cos_theta = in_dir.y;
@@ -137,6 +149,7 @@ Spectrum Pathtracer::trace_ray(const Ray& ray) {
                 // in shadow. Only accumulate light if not in shadow.
 
                 Ray sr(hit.position + sample.direction * EPS_F, sample.direction);
+                Ray_Stats::count_ray(&Ray_Stats::shadow_rays);
                 auto strace = scene.hit(sr);
                 float sRayToLight = (hit.position - strace.position).norm();
                 if(strace.hit && sRayToLight < sample.distance) {
@@ -153,7 +166,13 @@ Spectrum Pathtracer::trace_ray(const Ray& ray) {
                 // Note: that along with the typical cos_theta, pdf factors, we divide by samples.
                 // This is because we're doing another monte-carlo estimate of the lighting from
                 // area lights here.
-                El += ray.beta * (cos_theta / (samples * sample.pdf)) * sample.radiance * attenuation;
+                float weight = 1.0f;
+                if(mis_mode != MIS_Mode::none && !light.is_discrete()) {
+                    weight = mis_weight((float)samples, sample.pdf, 1.0f,
+                                        scatter_pdf(bsdf, hit.position, out_dir, in_dir, frame));
+                }
+                El += path.beta * (weight * cos_theta / (samples * sample.pdf)) * sample.radiance *
+                      attenuation;
             }
         };
 
@@ -170,33 +189,47 @@ Spectrum Pathtracer::trace_ray(const Ray& ray) {
         }
     }
     
-    Spectrum Lo = ray.Lo + El;
+    Spectrum Lo = Le + El;
     // TODO (PathTracer): Task 5
     // Compute an indirect lighting estimate using path tracing with Monte Carlo.
-    BSDF_Sample bsdf_s = bsdf.sample(out_dir);
-    //Lo += ray.beta * bsdf_s.emissive;
-    if(ray.depth == 0) {
+    // With path guiding enabled, sample_scatter mixes BSDF sampling with the learned guide.
+    BSDF_Sample bsdf_s = sample_scatter(bsdf, hit.position, out_dir, frame);
+    //Lo += path.beta * bsdf_s.emissive;
+    if(path.depth == 0 && mis_mode == MIS_Mode::none) {
         Lo += bsdf_s.emissive;
     } 
     
-
-    float q = 0.25f;//1.0f - std::min(1.0f, Lo.luma());
-    if (RNG::unit() < q){
-
-        return Lo;
+    // The roulette policy decides how many continuation paths to trace (see
+    // Pathtracer::split_paths) and whether each one survives (Pathtracer::roulette).
+    float split_weight = 1.0f;
+    size_t paths = split_paths(path, split_weight);
+    size_t continued = 0;
+
+    for(size_t i = 0; i < paths; i++) {
+
+        if(i > 0) bsdf_s = sample_scatter(bsdf, hit.position, out_dir, frame);
+
+        float dotN = bsdf_s.direction.y;
+        Spectrum beta = path.beta * bsdf_s.attenuation * (split_weight * dotN / bsdf_s.pdf);
+        if(!roulette(path.depth + 1, beta)) continue;
+
+        Ray ray_r(hit.position, frame.to_world(bsdf_s.direction));
+        Path path_r;
+        path_r.depth = path.depth + 1;
+        path_r.beta = beta;
+        path_r.pdf = bsdf.is_discrete() ? 0.0f : bsdf_s.pdf;
+        path_r.rcolor = Spectrum(dotN > 0.0f ? 0.0f: 1.0f);
+
+        //log_ray(ray_r, 1.0f, path_r.rcolor);
+        //log_ray(ray_r, 10.0f, Spectrum(1.0f, 0.0f, 0.0f));
+        Ray_Stats::count_ray(&Ray_Stats::bounce_rays);
+        continued++;
+        Spectrum Li = trace_ray(ray_r, path_r);
+        if(!bsdf.is_discrete()) record_guide(hit.position, ray_r.dir, Li, beta, bsdf_s.pdf);
+        Lo += Li;
     }
-    Ray ray_r(hit.position, object_to_world.rotate(bsdf_s.direction));
-    ray_r.depth = ray.depth + 1;
-    float dotN = dot(bsdf_s.direction, world_to_object.rotate(hit.normal));
-    
-    ray_r.beta = ray.beta * bsdf_s.attenuation * dotN/ bsdf_s.pdf;
-    ray_r.beta *= 1.0f / (1 - q);
-    ray_r.Lo = Lo;
-    ray_r.rcolor = Spectrum(dotN > 0.0f ? 0.0f: 1.0f);
-    
-    //log_ray(ray_r, 1.0f, ray_r.rcolor);
-    //log_ray(ray_r, 10.0f, Spectrum(1.0f, 0.0f, 0.0f));
-    return trace_ray(ray_r);
+    if(continued == 0) Ray_Stats::count_path(path.depth);
+    return Lo;
 
     /* if(bsdf.is_mirror()) {
       //BSDF_Sample bsdf_s = bsdf.sample(out_dir);
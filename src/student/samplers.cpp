@@ -29,6 +29,10 @@ Vec3 Hemisphere::Cosine::sample(float& pdf) const {
     return Vec3();
 }
 
+float Hemisphere::Cosine::pdf(Vec3 dir) const {
+    return dir.y > 0.0f ? dir.y / PI_F : 0.0f;
+}
+
 Vec3 Sphere::Uniform::sample(float& pdf) const {
 
     // TODO (PathTracer): Task 7
@@ -39,6 +43,10 @@ Vec3 Sphere::Uniform::sample(float& pdf) const {
     return Vec3();
 }
 
+float Sphere::Uniform::pdf(Vec3) const {
+    return 1.0f / (4.0f * PI_F);
+}
+
 Sphere::Image::Image(const HDR_Image& image) {
 
     // TODO (PathTracer): Task 7
@@ -93,4 +101,8 @@ Vec3 Hemisphere::Uniform::sample(float& pdf) const {
     return Vec3(xs, ys, zs);
 }
 
+float Hemisphere::Uniform::pdf(Vec3 dir) const {
+    return dir.y > 0.0f ? 1.0f / (2.0f * PI_F) : 0.0f;
+}
+
 } // namespace Samplers
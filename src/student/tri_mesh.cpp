@@ -94,16 +94,19 @@ Triangle::Triangle(Tri_Mesh_Vert* verts, unsigned int v0, unsigned int v1, unsig
 }
 
 void Tri_Mesh::build(const GL::Mesh& mesh) {
+    build(mesh.verts(), mesh.indices());
+}
+
+void Tri_Mesh::build(const std::vector<GL::Mesh::Vert>& mesh_verts,
+                     const std::vector<GL::Mesh::Index>& idxs) {
 
     verts.clear();
     triangles.clear();
 
-    for(const auto& v : mesh.verts()) {
+    for(const auto& v : mesh_verts) {
         verts.push_back({v.pos, v.norm});
     }
 
-    const auto& idxs = mesh.indices();
-
     std::vector<Triangle> tris;
     for(size_t i = 0; i < idxs.size(); i += 3) {
         tris.push_back(Triangle(verts.data(), idxs[i], idxs[i + 1], idxs[i + 2]));
@@ -116,6 +119,11 @@ Tri_Mesh::Tri_Mesh(const GL::Mesh& mesh) {
     build(mesh);
 }
 
+Tri_Mesh::Tri_Mesh(const std::vector<GL::Mesh::Vert>& verts,
+                   const std::vector<GL::Mesh::Index>& idxs) {
+    build(verts, idxs);
+}
+
 Tri_Mesh Tri_Mesh::copy() const {
     Tri_Mesh ret;
     ret.verts = verts;
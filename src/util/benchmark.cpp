@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cmath>
+
+#include "benchmark.h"
+#include "thread_pool.h"
+
+namespace Benchmark {
+
+// Seconds taken by the fastest of a few runs of f
+template<typename F> static double best_time(F&& f) {
+    double best = INFINITY;
+    for(int i = 0; i < 3; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        best = std::min(best, took.count());
+    }
+    return best;
+}
+
+std::string parallel() {
+
+    static const size_t compute_n = size_t(1) << 22, memory_n = size_t(1) << 25;
+    static const size_t grain = 4096;
+
+    std::vector<float> data(memory_n, 1.0f);
+    size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    info("Parallel benchmark settings:");
+    info("\tcompute loop: %zu iterations", compute_n);
+    info("\tmemory loop: %zu floats", memory_n);
+    info("\tgrain: %zu", grain);
+
+    double base_compute = 0.0, base_memory = 0.0, base_reduce = 0.0;
+    double checksum = 0.0;
+    info("threads, compute (s), speedup, memory (s), speedup, reduce (s), speedup");
+
+    for(size_t threads = 1;; threads = std::min(threads * 2, max_threads)) {
+
+        Thread_Pool pool(threads);
+
+        double compute = best_time([&]() {
+            parallel_for(pool, 0, compute_n, grain, [&](size_t b, size_t e) {
+                for(size_t i = b; i < e; i++) {
+                    float x = (float)i;
+                    data[i] = std::sin(x) * std::cos(x) + std::sqrt(x);
+                }
+            });
+        });
+        double memory = best_time([&]() {
+            parallel_for(pool, 0, memory_n, grain, [&](size_t b, size_t e) {
+                for(size_t i = b; i < e; i++) data[i] = data[i] * 0.5f + 1.0f;
+            });
+        });
+        double reduce = best_time([&]() {
+            checksum += parallel_reduce(
+                pool, 0, memory_n, grain, 0.0,
+                [&](size_t b, size_t e) {
+                    double sum = 0.0;
+                    for(size_t i = b; i < e; i++) sum += data[i];
+                    return sum;
+                },
+                [](double l, double r) { return l + r; });
+        });
+
+        if(threads == 1) {
+            base_compute = compute;
+            base_memory = memory;
+            base_reduce = reduce;
+        }
+        info("%zu, %.4f, %.2fx, %.4f, %.2fx, %.4f, %.2fx", threads, compute,
+             base_compute / compute, memory, base_memory / memory, reduce, base_reduce / reduce);
+
+        if(threads == max_threads) break;
+    }
+
+    if(!std::isfinite(checksum)) return "Benchmark produced a non-finite result!";
+    return {};
+}
+
+} // namespace Benchmark
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+namespace Benchmark {
+
+// Times parallel_for and parallel_reduce on a compute-bound and a
+// memory-bound loop with 1, 2, 4, ... workers and logs the speedup of each.
+std::string parallel();
+
+} // namespace Benchmark
@@ -83,6 +83,7 @@ void Camera::mouse_radius(float off) {
 
 void Camera::set_fov(float f) {
     vert_fov = f;
+    update_sensor();
 }
 
 float Camera::get_h_fov() const {
@@ -109,14 +110,17 @@ Vec3 Camera::center() const {
 
 void Camera::set_ar(float a) {
     aspect_ratio = a;
+    update_sensor();
 }
 
 void Camera::set_ar(Vec2 dim) {
     aspect_ratio = dim.x / dim.y;
+    update_sensor();
 }
 
 void Camera::set_ap(float ap) {
     aperture = ap;
+    update_sensor();
 }
 
 float Camera::get_ap() const {
@@ -136,4 +140,21 @@ void Camera::update_pos() {
     position = looking_at + radius * position.unit();
     iview = Mat4::translate(position) * rot.to_mat();
     view = iview.inverse();
+    update_sensor();
+}
+
+void Camera::update_sensor() {
+
+    // The sensor sits one unit down -Z in camera space
+    float h = 2.0f * std::tan(Radians(vert_fov) / 2.0f);
+    float w = h * aspect_ratio;
+    Vec3 right = rot.rotate(Vec3{1.0f, 0.0f, 0.0f});
+    Vec3 up = rot.rotate(Vec3{0.0f, 1.0f, 0.0f});
+    Vec3 forward = rot.rotate(Vec3{0.0f, 0.0f, -1.0f});
+
+    sensor_x = right * w;
+    sensor_y = up * h;
+    sensor_corner = forward - 0.5f * (sensor_x + sensor_y);
+    lens_x = right * aperture;
+    lens_y = up * aperture;
 }
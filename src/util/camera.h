@@ -1,8 +1,28 @@
 
 #pragma once
 
+#include <vector>
+
 #include "../lib/mathlib.h"
 
+// Camera rays for a batch of sensor positions, one array per component, so that
+// they can be generated a few at a time in SIMD lanes and handed on as packets
+struct Camera_Rays {
+
+    void resize(size_t n) {
+        for(auto c : {&ox, &oy, &oz, &dx, &dy, &dz}) c->resize(n);
+    }
+    size_t size() const {
+        return ox.size();
+    }
+    Ray get(size_t i) const {
+        return Ray(Vec3(ox[i], oy[i], oz[i]), Vec3(dx[i], dy[i], dz[i]));
+    }
+
+    std::vector<float> ox, oy, oz;
+    std::vector<float> dx, dy, dz;
+};
+
 class Camera {
 public:
     Camera(Vec2 dim);
@@ -15,6 +35,8 @@ public:
             corresponds to the middle of the screen.
     */
     Ray generate_ray(Vec2 screen_coord) const;
+    /// Same as generate_ray for each of n sensor positions, in one call
+    void generate_rays(const Vec2* screen_coords, size_t n, Camera_Rays& rays) const;
 
     /// View transformation matrix
     Mat4 get_view() const;
@@ -59,6 +81,7 @@ public:
 
 private:
     void update_pos();
+    void update_sensor();
 
     /// Camera parameters
     Vec3 position, looking_at;
@@ -76,4 +99,10 @@ private:
 
     /// Cached view matrices
     Mat4 view, iview;
+
+    /// Ray generation basis in world space, kept up to date with the parameters above.
+    /// The ray through sensor position (x,y) of a pinhole camera points along
+    /// sensor_corner + x * sensor_x + y * sensor_y; the lens axes are scaled by the aperture.
+    Vec3 sensor_corner, sensor_x, sensor_y;
+    Vec3 lens_x, lens_y;
 };
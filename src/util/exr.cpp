@@ -0,0 +1,103 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "exr.h"
+
+namespace EXR {
+
+// OpenEXR is little-endian, as are all of our target platforms
+template<typename T> static void put(std::vector<char>& out, T value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+static void put_str(std::vector<char>& out, const std::string& str) {
+    out.insert(out.end(), str.begin(), str.end());
+    out.push_back('\0');
+}
+
+static void put_attr(std::vector<char>& out, const std::string& name, const std::string& type,
+                     const std::vector<char>& value) {
+    put_str(out, name);
+    put_str(out, type);
+    put<int32_t>(out, (int32_t)value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+std::string write(std::string path, size_t w, size_t h, const std::vector<std::string>& channels,
+                  const Row_Fn& row) {
+
+    static const int32_t pixel_float = 2;
+    static const char no_compression = 0, increasing_y = 0;
+
+    if(!w || !h || channels.empty()) return "Nothing to write!";
+
+    std::vector<char> header, value;
+    put<int32_t>(header, 20000630);
+    put<int32_t>(header, 2);
+
+    for(const std::string& name : channels) {
+        put_str(value, name);
+        put<int32_t>(value, pixel_float);
+        put<int32_t>(value, 0); // pLinear and reserved
+        put<int32_t>(value, 1);
+        put<int32_t>(value, 1);
+    }
+    value.push_back('\0');
+    put_attr(header, "channels", "chlist", value);
+
+    put_attr(header, "compression", "compression", {no_compression});
+
+    value.clear();
+    put<int32_t>(value, 0);
+    put<int32_t>(value, 0);
+    put<int32_t>(value, (int32_t)w - 1);
+    put<int32_t>(value, (int32_t)h - 1);
+    put_attr(header, "dataWindow", "box2i", value);
+    put_attr(header, "displayWindow", "box2i", value);
+
+    put_attr(header, "lineOrder", "lineOrder", {increasing_y});
+
+    value.clear();
+    put<float>(value, 1.0f);
+    put_attr(header, "pixelAspectRatio", "float", value);
+
+    value.clear();
+    put<float>(value, 0.0f);
+    put<float>(value, 0.0f);
+    put_attr(header, "screenWindowCenter", "v2f", value);
+
+    value.clear();
+    put<float>(value, 1.0f);
+    put_attr(header, "screenWindowWidth", "float", value);
+    header.push_back('\0');
+
+    // Uncompressed scanline chunks hold one row each and all have the same size
+    size_t row_bytes = channels.size() * w * sizeof(float);
+    uint64_t offset = header.size() + h * sizeof(uint64_t);
+    for(size_t y = 0; y < h; y++) {
+        put<uint64_t>(header, offset);
+        offset += 2 * sizeof(int32_t) + row_bytes;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if(!file) return "Failed to open " + path + " for writing!";
+    file.write(header.data(), header.size());
+
+    std::vector<float> data(w);
+    for(size_t y = 0; y < h; y++) {
+        int32_t chunk[2] = {(int32_t)y, (int32_t)row_bytes};
+        file.write((const char*)chunk, sizeof(chunk));
+        for(size_t c = 0; c < channels.size(); c++) {
+            row(y, c, data.data());
+            file.write((const char*)data.data(), w * sizeof(float));
+        }
+    }
+
+    if(!file) return "Failed to write " + path + "!";
+    return {};
+}
+
+} // namespace EXR
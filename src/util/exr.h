@@ -0,0 +1,18 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace EXR {
+
+// Fills row (w floats) with channel c of scanline y, counting from the top
+using Row_Fn = std::function<void(size_t y, size_t c, float* row)>;
+
+// Writes an uncompressed 32-bit float scanline OpenEXR file one scanline at a
+// time, so the only buffer needed is a single row of one channel. Channel
+// names must be given in sorted order.
+std::string write(std::string path, size_t w, size_t h, const std::vector<std::string>& channels,
+                  const Row_Fn& row);
+
+} // namespace EXR
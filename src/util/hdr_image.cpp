@@ -1,6 +1,13 @@
 
 #include "hdr_image.h"
 #include "../lib/log.h"
+#include "exr.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
 
 #include <sf_libs/stb_image.h>
 #include <sf_libs/tinyexr.h>
@@ -11,12 +18,13 @@ HDR_Image::HDR_Image() : w(0), h(0) {
 HDR_Image::HDR_Image(size_t w, size_t h) : w(w), h(h) {
     assert(w > 0 && h > 0);
     pixels.resize(w * h);
+    mark_all();
 }
 
 HDR_Image HDR_Image::copy() const {
     HDR_Image ret;
     ret.resize(w, h);
-    ret.pixels.insert(ret.pixels.begin(), pixels.begin(), pixels.end());
+    ret.pixels = pixels;
     ret.last_path = last_path;
     ret.dirty = true;
     ret.exposure = exposure;
@@ -32,11 +40,17 @@ void HDR_Image::resize(size_t _w, size_t _h) {
     h = _h;
     pixels.clear();
     pixels.resize(w * h);
-    dirty = true;
+    mark_all();
 }
 
 void HDR_Image::clear(Spectrum color) {
     for(auto& s : pixels) s = color;
+    mark_all();
+}
+
+void HDR_Image::mark_all() {
+    tiles_x = (w + tile_size - 1) / tile_size;
+    tile_dirty.assign(tiles_x * ((h + tile_size - 1) / tile_size), 1);
     dirty = true;
 }
 
@@ -64,6 +78,27 @@ Spectrum HDR_Image::at(size_t x, size_t y) const {
     return pixels[idx];
 }
 
+Spectrum* HDR_Image::row(size_t y) {
+    assert(y < h);
+    return &pixels[y * w];
+}
+
+const Spectrum* HDR_Image::row(size_t y) const {
+    assert(y < h);
+    return &pixels[y * w];
+}
+
+void HDR_Image::mark(size_t x0, size_t y0, size_t x1, size_t y1) {
+    assert(x0 <= x1 && x1 <= w && y0 <= y1 && y1 <= h);
+    if(x0 == x1 || y0 == y1) return;
+    for(size_t ty = y0 / tile_size; ty <= (y1 - 1) / tile_size; ty++) {
+        for(size_t tx = x0 / tile_size; tx <= (x1 - 1) / tile_size; tx++) {
+            tile_dirty[ty * tiles_x + tx] = 1;
+        }
+    }
+    marked = true;
+}
+
 std::string HDR_Image::load_from(std::string file) {
 
     if(IsEXR(file.c_str()) == TINYEXR_SUCCESS) {
@@ -135,6 +170,38 @@ std::string HDR_Image::loaded_from() const {
     return last_path;
 }
 
+float HDR_Image::rmse(const HDR_Image& reference) const {
+
+    assert(w == reference.w && h == reference.h);
+    if(pixels.empty()) return 0.0f;
+
+    double sum = 0.0;
+    for(size_t i = 0; i < pixels.size(); i++) {
+        Spectrum d = pixels[i] - reference.pixels[i];
+        sum += (double)d.r * d.r + (double)d.g * d.g + (double)d.b * d.b;
+    }
+    return (float)std::sqrt(sum / (3.0 * pixels.size()));
+}
+
+float HDR_Image::rel_mse(const HDR_Image& reference) const {
+
+    assert(w == reference.w && h == reference.h);
+    if(pixels.empty()) return 0.0f;
+
+    // The offset keeps black reference pixels from dominating
+    static const double eps = 0.01;
+
+    double sum = 0.0;
+    for(size_t i = 0; i < pixels.size(); i++) {
+        Spectrum p = pixels[i], r = reference.pixels[i];
+        for(int c = 0; c < 3; c++) {
+            double d = (double)p.data[c] - r.data[c];
+            sum += d * d / ((double)r.data[c] * r.data[c] + eps);
+        }
+    }
+    return (float)(sum / (3.0 * pixels.size()));
+}
+
 void HDR_Image::tonemap(float e) const {
 
     if(e <= 0.0f) {
@@ -144,13 +211,20 @@ void HDR_Image::tonemap(float e) const {
         dirty = true;
     }
 
-    if(!dirty) return;
+    if(!dirty && !marked) return;
 
-    std::vector<unsigned char> data;
-    tonemap_to(data, e);
-    render_tex.image((int)w, (int)h, data.data());
+    // Only the tiles marked since the last call need to be tonemapped again,
+    // unless at() wrote anywhere or the exposure changed
+    if(dirty || tonemapped.size() != w * h * 4 || e != tonemapped_exposure) {
+        tonemapped.resize(w * h * 4);
+        std::fill(tile_dirty.begin(), tile_dirty.end(), 1);
+        tonemapped_exposure = e;
+    }
+    tonemap_tiles(tonemapped, e, true);
+    std::fill(tile_dirty.begin(), tile_dirty.end(), 0);
+    render_tex.image((int)w, (int)h, tonemapped.data());
 
-    dirty = false;
+    dirty = marked = false;
 }
 
 const GL::Tex2D& HDR_Image::get_texture(float e) const {
@@ -158,32 +232,128 @@ const GL::Tex2D& HDR_Image::get_texture(float e) const {
     return render_tex;
 }
 
-void HDR_Image::tonemap_to(std::vector<unsigned char>& data, float e) const {
+std::string HDR_Image::save_pfm(std::string file) const {
 
-    if(e <= 0.0f) {
-        e = exposure;
-    }
+    static_assert(sizeof(Spectrum) == 3 * sizeof(float),
+                  "PFM rows are written straight from pixels");
 
-    if(data.size() != w * h * 4) data.resize(w * h * 4);
+    std::ofstream out(file, std::ios::binary);
+    if(!out) return "Failed to open " + file + " for writing!";
 
+    // PFM stores rows bottom to top, like pixels; a negative scale means little-endian
+    out << "PF\n" << w << " " << h << "\n-1.0\n";
     for(size_t j = 0; j < h; j++) {
-        for(size_t i = 0; i < w; i++) {
+        out.write((const char*)&pixels[j * w], w * sizeof(Spectrum));
+    }
+
+    if(!out) return "Failed to write " + file + "!";
+    return {};
+}
+
+std::string HDR_Image::save_exr(std::string file) const {
 
-            size_t pidx = (h - j - 1) * w + i;
-            const Spectrum& sample = pixels[pidx];
+    // EXR scanlines run top to bottom, and channels are sorted by name
+    return EXR::write(file, w, h, {"B", "G", "R"}, [this](size_t y, size_t c, float* row) {
+        const Spectrum* src = &pixels[(h - y - 1) * w];
+        for(size_t i = 0; i < w; i++) row[i] = src[i].data[2 - c];
+    });
+}
 
-            float r = 1.0f - std::exp(-sample.r * exposure);
-            float g = 1.0f - std::exp(-sample.g * exposure);
-            float b = 1.0f - std::exp(-sample.b * exposure);
+// exp(x) for x in [-87, 0]: 2^t is split into 2^i * 2^f with f in [-0.5, 0.5],
+// where 2^f is a degree-5 polynomial (relative error below 2e-6). There are no
+// branches or library calls, so the loops using it vectorize.
+static float fast_exp(float x) {
+    float t = x * 1.44269504f;
+    float i = (float)(int)(t - 0.5f);
+    float f = t - i;
+
+    float p = 1.33335581e-3f;
+    p = p * f + 9.61812911e-3f;
+    p = p * f + 5.55041087e-2f;
+    p = p * f + 2.40226507e-1f;
+    p = p * f + 6.93147181e-1f;
+    p = p * f + 1.0f;
+
+    int32_t bits = ((int32_t)i + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return p * scale;
+}
 
-            Spectrum out(r, g, b);
-            out.make_srgb();
+// Maps sqrt(v) to the 8-bit gamma-encoded value of v, for v in [0, 1]. Indexing
+// by the square root puts more entries where the gamma curve is steepest.
+static const size_t lut_size = 4096;
 
-            size_t didx = 4 * (j * w + i);
-            data[didx] = (unsigned char)std::round(out.r * 255.0f);
-            data[didx + 1] = (unsigned char)std::round(out.g * 255.0f);
-            data[didx + 2] = (unsigned char)std::round(out.b * 255.0f);
-            data[didx + 3] = 255;
+static const unsigned char* gamma_lut() {
+    static const std::vector<unsigned char> lut = [] {
+        std::vector<unsigned char> ret(lut_size);
+        for(size_t i = 0; i < lut_size; i++) {
+            float u = (float)i / (lut_size - 1);
+            ret[i] = (unsigned char)std::round(std::pow(u * u, 1.0f / GAMMA) * 255.0f);
         }
+        return ret;
+    }();
+    return lut.data();
+}
+
+// Tonemaps n pixels to RGBA, using idx (3n ints) as scratch space
+static void tonemap_row(const Spectrum* src, size_t n, float e, int* idx, unsigned char* dst) {
+
+    const unsigned char* lut = gamma_lut();
+    const float* in = src->data;
+
+    for(size_t k = 0; k < 3 * n; k++) {
+        float x = in[k] * e;
+        x = x > 0.0f ? x : 0.0f; // also catches NaN
+        x = x < 87.0f ? x : 87.0f;
+        float v = 1.0f - fast_exp(-x);
+        v = v > 0.0f ? v : 0.0f;
+        idx[k] = (int)(std::sqrt(v) * (lut_size - 1) + 0.5f);
     }
+    for(size_t i = 0; i < n; i++) {
+        dst[4 * i] = lut[idx[3 * i]];
+        dst[4 * i + 1] = lut[idx[3 * i + 1]];
+        dst[4 * i + 2] = lut[idx[3 * i + 2]];
+        dst[4 * i + 3] = 255;
+    }
+}
+
+void HDR_Image::tonemap_tiles(std::vector<unsigned char>& data, float e, bool only_dirty) const {
+
+    // Below this many pixels, handing out tiles costs more than it saves
+    static const size_t parallel_pixels = 256 * 256;
+
+    std::vector<size_t> tiles;
+    for(size_t t = 0; t < tile_dirty.size(); t++) {
+        if(!only_dirty || tile_dirty[t]) tiles.push_back(t);
+    }
+    if(tiles.empty()) return;
+
+    // The GUI refreshes its output while renders keep the pool busy. Workers only
+    // pick up interactive tasks between rows, so when none is free the calling
+    // thread tonemaps every tile itself rather than waiting for one.
+    size_t grain = parallel_pixels / (tile_size * tile_size);
+    parallel_for(Thread_Pool::shared(), 0, tiles.size(), grain, [&](size_t begin, size_t end) {
+        std::vector<int> idx(3 * tile_size);
+        for(size_t n = begin; n < end; n++) {
+            size_t x0 = (tiles[n] % tiles_x) * tile_size, y0 = (tiles[n] / tiles_x) * tile_size;
+            size_t x1 = std::min(x0 + tile_size, w), y1 = std::min(y0 + tile_size, h);
+
+            // Pixel rows run bottom to top, output rows top to bottom
+            for(size_t y = y0; y < y1; y++) {
+                tonemap_row(&pixels[y * w + x0], x1 - x0, e, idx.data(),
+                            &data[4 * ((h - y - 1) * w + x0)]);
+            }
+        }
+    }, Priority::interactive);
+}
+
+void HDR_Image::tonemap_to(std::vector<unsigned char>& data, float e) const {
+
+    if(e <= 0.0f) {
+        e = exposure;
+    }
+
+    if(data.size() != w * h * 4) data.resize(w * h * 4);
+    tonemap_tiles(data, e, false);
 }
@@ -24,6 +24,12 @@ public:
     Spectrum& at(size_t i);
     Spectrum at(size_t i) const;
 
+    /// Pixels of row y. Writes through it are not tracked, so follow them with mark()
+    Spectrum* row(size_t y);
+    const Spectrum* row(size_t y) const;
+    /// Mark [x0, x1) x [y0, y1) as changed, so the texture only re-tonemaps its tiles
+    void mark(size_t x0, size_t y0, size_t x1, size_t y1);
+
     void clear(Spectrum color);
     void resize(size_t w, size_t h);
     std::pair<size_t, size_t> dimension() const;
@@ -31,17 +37,32 @@ public:
     std::string load_from(std::string file);
     std::string loaded_from() const;
 
+    /// Write raw radiance (no exposure or tonemapping) as 32-bit float data
+    std::string save_pfm(std::string file) const;
+    std::string save_exr(std::string file) const;
+
+    float rmse(const HDR_Image& reference) const;
+    /// Squared error relative to the reference's brightness, so dark and bright pixels count alike
+    float rel_mse(const HDR_Image& reference) const;
+
     void tonemap_to(std::vector<unsigned char>& data, float exposure = 0.0f) const;
     const GL::Tex2D& get_texture(float exposure = 0.0f) const;
 
 private:
+    // Pixels are grouped into square tiles. Writes through at() make the texture
+    // re-tonemap every tile; mark() lets bulk writers name the tiles they changed.
+    static const size_t tile_size = 64;
+
     void tonemap(float exposure = 0.0f) const;
+    void tonemap_tiles(std::vector<unsigned char>& data, float exposure, bool only_dirty) const;
+    void mark_all();
 
-    size_t w, h;
+    size_t w, h, tiles_x = 0;
     std::string last_path;
     std::vector<Spectrum> pixels;
 
     mutable GL::Tex2D render_tex;
-    mutable float exposure = 1.0f;
-    mutable bool dirty = true;
+    mutable std::vector<unsigned char> tonemapped, tile_dirty;
+    mutable float exposure = 1.0f, tonemapped_exposure = 0.0f;
+    mutable bool dirty = true, marked = false;
 };
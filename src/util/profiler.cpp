@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "profiler.h"
+
+namespace Profiler {
+
+std::atomic<bool> recording(false);
+
+// Each buffer keeps its thread's most recent zones, overwriting the oldest
+static const size_t buffer_size = size_t(1) << 15;
+
+struct Event {
+    const char* name;
+    std::chrono::steady_clock::time_point start, end;
+};
+
+struct Buffer {
+    // Only contended while the trace is being written
+    std::mutex mut;
+    size_t id = 0;
+    std::string name;
+    std::vector<Event> events;
+    size_t count = 0;
+};
+
+static std::mutex buffers_mut;
+static std::vector<std::shared_ptr<Buffer>> buffers;
+static std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+
+static Buffer& local_buffer() {
+    static thread_local std::shared_ptr<Buffer> local;
+    if(!local) {
+        local = std::make_shared<Buffer>();
+        std::lock_guard<std::mutex> lock(buffers_mut);
+        local->id = buffers.size();
+        buffers.push_back(local);
+    }
+    return *local;
+}
+
+void enable(bool on) {
+    recording = on;
+}
+
+void name_thread(const std::string& name) {
+    Buffer& buf = local_buffer();
+    std::lock_guard<std::mutex> lock(buf.mut);
+    buf.name = name;
+}
+
+void record(const char* name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end) {
+
+    Buffer& buf = local_buffer();
+    std::lock_guard<std::mutex> lock(buf.mut);
+    if(buf.events.empty()) buf.events.resize(buffer_size);
+    buf.events[buf.count++ % buffer_size] = {name, start, end};
+}
+
+std::string write(const std::string& path) {
+
+    std::ofstream out(path);
+    if(!out) return "Failed to open " + path + " for writing!";
+
+    auto micros = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    };
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+
+    std::lock_guard<std::mutex> buffers_lock(buffers_mut);
+    for(const auto& buf : buffers) {
+        std::lock_guard<std::mutex> lock(buf->mut);
+
+        std::string name = buf->name.empty() ? "Thread " + std::to_string(buf->id) : buf->name;
+        out << (first ? "" : ",\n") << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 0, "
+            << "\"tid\": " << buf->id << ", \"args\": {\"name\": \"" << name << "\"}}";
+        first = false;
+
+        size_t n = std::min(buf->count, buffer_size);
+        for(size_t i = buf->count - n; i < buf->count; i++) {
+            const Event& e = buf->events[i % buffer_size];
+            out << ",\n{\"ph\": \"X\", \"name\": \"" << e.name << "\", \"pid\": 0, \"tid\": "
+                << buf->id << ", \"ts\": " << micros(e.start - origin)
+                << ", \"dur\": " << micros(e.end - e.start) << "}";
+        }
+    }
+    out << "\n]}\n";
+
+    if(!out) return "Failed to write " + path + "!";
+    return {};
+}
+
+} // namespace Profiler
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Records named zones of time on every thread into per-thread ring buffers,
+// which can be written out as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev). When recording is off a zone costs one relaxed load.
+namespace Profiler {
+
+extern std::atomic<bool> recording;
+
+/// Start or stop recording; zones already recorded are kept
+void enable(bool on);
+/// Name the calling thread in the trace
+void name_thread(const std::string& name);
+/// Write the zones still held in the buffers as Chrome trace JSON
+std::string write(const std::string& path);
+
+void record(const char* name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+
+// Records the time from its construction to its destruction. The name must
+// outlive the program, e.g. a string literal.
+class Zone {
+public:
+    explicit Zone(const char* name)
+        : name(recording.load(std::memory_order_relaxed) ? name : nullptr) {
+        if(this->name) start = std::chrono::steady_clock::now();
+    }
+    ~Zone() {
+        if(name) record(name, start, std::chrono::steady_clock::now());
+    }
+
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+private:
+    const char* name;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace Profiler
@@ -32,4 +32,9 @@ void seed() {
     rng.seed(seed);
 }
 
+void seed(unsigned int base, size_t stream) {
+    std::seed_seq seq{base, (unsigned int)stream, (unsigned int)((unsigned long long)stream >> 32)};
+    rng.seed(seq);
+}
+
 } // namespace RNG
@@ -16,4 +16,7 @@ bool coin_flip(float p = 0.5f);
 
 // Seed the current thread's PRNG
 void seed();
+
+// Seed the current thread's PRNG repeatably; each stream gives a different sequence
+void seed(unsigned int base, size_t stream);
 } // namespace RNG
@@ -1,72 +1,407 @@
-
 #include "thread_pool.h"
+#include "../util/profiler.h"
 #include "../util/rand.h"
 
-Thread_Pool::Thread_Pool(size_t threads) {
-    start(threads);
+#include <fstream>
+#include <sstream>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Identifies the pool and index of the worker running on this thread, if any
+static thread_local const Thread_Pool* worker_pool = nullptr;
+static thread_local size_t worker_index = 0;
+
+static bool pin_shared_pool = false;
+
+static const char* Task_Zones[(int)Priority::count] = {"Task (interactive)", "Task (normal)",
+                                                       "Task (background)"};
+
+// Parses a sysfs CPU or node list, such as "0-3,8-11"
+static std::vector<int> parse_list(const std::string& list) {
+    std::vector<int> ret;
+    std::stringstream str(list);
+    std::string range;
+    while(std::getline(str, range, ',')) {
+        if(range.empty()) continue;
+        size_t dash = range.find('-');
+        int lo = std::stoi(range.substr(0, dash));
+        int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+        for(int i = lo; i <= hi; i++) ret.push_back(i);
+    }
+    return ret;
 }
 
-Thread_Pool::~Thread_Pool() {
-    stop();
+// CPUs this process may run on, grouped by NUMA node. Empty if unknown.
+static std::vector<std::vector<int>> cpu_nodes() {
+
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return nodes;
+
+    auto usable = [&](int cpu) {
+        return cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed);
+    };
+
+    std::string line;
+    std::ifstream online("/sys/devices/system/node/online");
+    if(online && std::getline(online, line)) {
+        for(int n : parse_list(line)) {
+            std::ifstream list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+            if(!list || !std::getline(list, line)) continue;
+
+            std::vector<int> node;
+            for(int cpu : parse_list(line)) {
+                if(usable(cpu)) node.push_back(cpu);
+            }
+            if(!node.empty()) nodes.push_back(node);
+        }
+    }
+
+    // No NUMA information: treat every usable CPU as one node
+    if(nodes.empty()) {
+        std::vector<int> node;
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(usable(cpu)) node.push_back(cpu);
+        }
+        if(!node.empty()) nodes.push_back(node);
+    }
+#endif
+    return nodes;
+}
+
+Thread_Pool::Thread_Pool(size_t threads, bool pin)
+    : n_threads(std::max(threads, size_t(1))), stopping(false), generation(0), queued(0),
+      unfinished(0) {
+    for(auto& w : waiting) w = 0;
+    for(size_t i = 0; i < n_threads; i++) queues.push_back(std::make_unique<Worker>());
+    place_workers(pin);
+    for(size_t i = 0; i < n_threads; i++) workers.emplace_back([this, i] { run(i); });
 }
 
-void Thread_Pool::start(size_t threads) {
-    n_threads = threads;
-    stop_now = false;
-    stop_when_done = false;
-    for(size_t i = 0; i < threads; i++)
-        workers.emplace_back([this] {
-            RNG::seed();
-            for(;;) {
-                std::function<void()> task;
-                {
-                    std::unique_lock<std::mutex> lock(this->queue_mutex);
-                    this->condition.wait(lock, [this] {
-                        return this->stop_now || this->stop_when_done || !this->tasks.empty();
-                    });
-                    if(this->stop_now || (this->stop_when_done && this->tasks.empty())) return;
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
-                }
-                task();
+void Thread_Pool::place_workers(bool pin) {
+
+    std::vector<std::vector<int>> nodes;
+    if(pin) nodes = cpu_nodes();
+    if(pin && nodes.empty()) warn("Could not read the CPU topology; workers are not pinned.");
+
+    // Deal workers out over the nodes in turn, so that a pool smaller than
+    // the machine still uses the memory bandwidth of every node
+    std::vector<size_t> node_of(n_threads, 0);
+    if(!nodes.empty()) {
+        std::vector<size_t> used(nodes.size(), 0);
+        for(size_t i = 0; i < n_threads; i++) {
+            size_t n = i % nodes.size();
+            node_of[i] = n;
+            queues[i]->cpu = nodes[n][used[n]++ % nodes[n].size()];
+        }
+        info("Pinned %zu workers to %zu NUMA node(s).", n_threads, nodes.size());
+    }
+
+    for(size_t i = 0; i < n_threads; i++) {
+        std::vector<size_t>& victims = queues[i]->victims;
+        for(int remote = 0; remote < 2; remote++) {
+            for(size_t j = 1; j < n_threads; j++) {
+                size_t v = (i + j) % n_threads;
+                if((node_of[v] != node_of[i]) == (bool)remote) victims.push_back(v);
             }
-        });
+        }
+    }
 }
 
-void Thread_Pool::clear() {
+Thread_Pool::~Thread_Pool() {
     stop();
-    start(n_threads);
 }
 
-void Thread_Pool::wait() {
+size_t Thread_Pool::size() const {
+    return n_threads;
+}
+
+Thread_Pool& Thread_Pool::shared() {
+    static Thread_Pool pool(std::max(1u, std::thread::hardware_concurrency()), pin_shared_pool);
+    return pool;
+}
 
+void Thread_Pool::pin_shared(bool pin) {
+    pin_shared_pool = pin;
+}
+
+int Thread_Pool::current_worker() const {
+    return worker_pool == this ? (int)worker_index : -1;
+}
+
+void Thread_Pool::push(Task_Fn&& fn, Priority priority) {
+
+    assert(!stopping);
+    int p = (int)priority;
+    unfinished++;
+    queued++;
+    waiting[p]++;
+
+    Task task{std::move(fn), generation.load()};
+    int self = current_worker();
+    if(self >= 0) {
+        std::lock_guard<std::mutex> lock(queues[self]->mut);
+        queues[self]->tasks[p].push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(injected_mut);
+        injected[p].push_back(std::move(task));
+    }
+
+    // Taking the lock orders this with a worker about to go to sleep
+    bool help;
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        stop_when_done = true;
+        std::lock_guard<std::mutex> lock(sleep_mut);
+        help = helpers > 0;
     }
+    wake.notify_one();
+    if(help) helping.notify_all();
+}
 
-    condition.notify_all();
-    for(std::thread& worker : workers) {
-        worker.join();
+void Thread_Pool::notify_helpers() {
+    std::lock_guard<std::mutex> lock(sleep_mut);
+    if(helpers > 0) helping.notify_all();
+}
+
+bool Thread_Pool::runnable(Priority lowest) const {
+    for(int p = 0; p <= (int)lowest; p++) {
+        if(waiting[p].load() > 0) return true;
     }
-    workers.clear();
+    return false;
+}
 
-    start(n_threads);
+bool Thread_Pool::pop(size_t self, Priority priority, Task& task) {
+
+    // Own work newest-first, then injected work, then steal the oldest from others
+    int p = (int)priority;
+    if(self < n_threads) {
+        std::lock_guard<std::mutex> lock(queues[self]->mut);
+        if(!queues[self]->tasks[p].empty()) {
+            task = std::move(queues[self]->tasks[p].back());
+            queues[self]->tasks[p].pop_back();
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(injected_mut);
+        if(!injected[p].empty()) {
+            task = std::move(injected[p].front());
+            injected[p].pop_front();
+            return true;
+        }
+    }
+    for(size_t i = 1; i <= n_threads; i++) {
+        size_t victim = self < n_threads ? (i < n_threads ? queues[self]->victims[i - 1] : self)
+                                         : (self + i) % n_threads;
+        if(victim == self) continue;
+        std::lock_guard<std::mutex> lock(queues[victim]->mut);
+        if(!queues[victim]->tasks[p].empty()) {
+            task = std::move(queues[victim]->tasks[p].front());
+            queues[victim]->tasks[p].pop_front();
+            return true;
+        }
+    }
+    return false;
 }
 
-void Thread_Pool::stop() {
+bool Thread_Pool::run_one(Priority lowest) {
+
+    int self = current_worker();
+    size_t from = self >= 0 ? (size_t)self : n_threads;
+
+    // Skip lanes with nothing waiting without touching any locks
+    Task task;
+    int p = 0;
+    for(; p <= (int)lowest; p++) {
+        if(waiting[p].load() > 0 && pop(from, (Priority)p, task)) break;
+    }
+    if(p > (int)lowest) return false;
+    waiting[p]--;
+    queued--;
 
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
-        stop_now = true;
+        Profiler::Zone zone(Task_Zones[p]);
+        task.fn(!stopping && task.generation == generation.load());
+    }
+
+    if(unfinished.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(sleep_mut);
+        idle.notify_all();
+    }
+    return true;
+}
+
+bool Thread_Pool::yield(Priority priority) {
+    if(priority == Priority::interactive) return false;
+    bool ran = false;
+    while(run_one((Priority)((int)priority - 1))) ran = true;
+    return ran;
+}
+
+void Thread_Pool::run(size_t self) {
+
+    worker_pool = this;
+    worker_index = self;
+    RNG::seed();
+    Profiler::name_thread("Worker " + std::to_string(self));
+
+#ifdef __linux__
+    if(queues[self]->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(queues[self]->cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+
+    for(;;) {
+        if(run_one()) continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mut);
+        wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if(stopping && queued.load() == 0) return;
     }
+}
+
+void Thread_Pool::wait() {
+    std::unique_lock<std::mutex> lock(sleep_mut);
+    idle.wait(lock, [this] { return unfinished.load() == 0; });
+}
+
+void Thread_Pool::clear() {
+    generation++;
+    wait();
+}
+
+void Thread_Pool::stop() {
+
+    if(workers.empty()) return;
 
-    condition.notify_all();
+    // Queued tasks are skipped, not run, but still released
+    generation++;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mut);
+        stopping = true;
+    }
+    wake.notify_all();
+    helping.notify_all();
     for(std::thread& worker : workers) {
         worker.join();
     }
     workers.clear();
+}
+
+Task_Group::Task_Group(Thread_Pool& pool, Priority priority)
+    : pool(pool), priority(priority), state(std::make_shared<State>()) {
+}
+
+Task_Group::~Task_Group() {
+    wait();
+}
+
+void Task_Group::wait() {
+
+    // A worker waiting on its own pool would otherwise hold up a thread the
+    // group's tasks may need, so it helps out until they are done. It only
+    // takes tasks at least as urgent as the group's, so a wait can't get stuck
+    // behind a long background task.
+    if(pool.current_worker() >= 0) {
+        pool.wait_until(priority, [this] { return state->pending.load() == 0; });
+    }
+
+    std::unique_lock<std::mutex> lock(state->mut);
+    state->done.wait(lock, [this] { return state->pending.load() == 0; });
+}
+
+void Task_Group::cancel() {
+    current.flag->store(true);
+    current = Cancel_Token();
+}
+
+Cancel_Token Task_Group::token() const {
+    return current;
+}
+
+Task_Graph::Task_Graph(Thread_Pool& pool, Priority priority)
+    : pool(pool), priority(priority), group(pool, priority) {
+}
+
+Task_Graph::~Task_Graph() {
+    wait();
+}
+
+Task_Graph::Node Task_Graph::add(std::function<void()> f, const std::vector<Node>& deps) {
+
+    Node node = tasks.size();
+    auto task = std::make_unique<Task>();
+    task->fn = std::move(f);
+    task->remaining = deps.size();
+    for(Node dep : deps) {
+        assert(dep < node);
+        tasks[dep]->dependents.push_back(node);
+    }
+    tasks.push_back(std::move(task));
+    return node;
+}
+
+void Task_Graph::run() {
+
+    // Find the roots first, since dependents may start while we loop
+    std::vector<Node> roots;
+    for(Node n = 0; n < tasks.size(); n++) {
+        if(tasks[n]->remaining.load() == 0) roots.push_back(n);
+    }
+    for(Node n : roots) start(n);
+}
+
+void Task_Graph::run_inline() {
+    for(Node n = 0; n < tasks.size(); n++) {
+        tasks[n]->fn();
+        std::lock_guard<std::mutex> lock(mut);
+        tasks[n]->done = true;
+    }
+}
+
+void Task_Graph::start(Node node) {
+    group.run([this, node]() {
+        tasks[node]->fn();
+        finish(node);
+    });
+}
+
+void Task_Graph::finish(Node node) {
+
+    // Dependents join the group before this task leaves it, so wait() can't
+    // see the group empty in between
+    for(Node d : tasks[node]->dependents) {
+        if(tasks[d]->remaining.fetch_sub(1) == 1) start(d);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        tasks[node]->done = true;
+    }
+    cond.notify_all();
+    pool.notify_helpers();
+}
+
+void Task_Graph::wait() {
+    group.wait();
+}
+
+void Task_Graph::wait(Node node) {
+
+    // As with Task_Group, a waiting worker runs other tasks in the meantime
+    if(pool.current_worker() >= 0) {
+        pool.wait_until(priority, [this, node] {
+            std::lock_guard<std::mutex> lock(mut);
+            return tasks[node]->done;
+        });
+        return;
+    }
 
-    std::queue<std::function<void()>> empty;
-    std::swap(tasks, empty);
+    std::unique_lock<std::mutex> lock(mut);
+    cond.wait(lock, [this, node] { return tasks[node]->done; });
 }
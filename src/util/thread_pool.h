@@ -1,50 +1,309 @@
-
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <vector>
 
 #include "../lib/log.h"
 
+// Workers always take the most urgent task available. Long-running tasks can
+// call Thread_Pool::yield() to let more urgent work run on their thread.
+enum class Priority : int { interactive, normal, background, count };
+
+// Persistent pool of workers. Each worker owns a deque: tasks submitted from a
+// worker go to the back of its own deque and it pops from there, while idle
+// workers steal from the front of others'. Tasks submitted from other threads
+// go to a shared injection queue. Waiting and clearing never restart the workers.
+// Pinned pools tie each worker to one CPU, spreading them over NUMA nodes, and
+// steal from workers on the same node before going to other nodes (Linux only).
 class Thread_Pool {
 public:
-    Thread_Pool(size_t threads);
+    Thread_Pool(size_t threads, bool pin = false);
     ~Thread_Pool();
 
     void stop();
+    /// Block until every submitted task has finished
     void wait();
+    /// Skip every task that has not started yet, then wait for the running ones
     void clear();
 
+    size_t size() const;
+
+    /// Run tasks more urgent than priority until none are waiting; true if any ran
+    bool yield(Priority priority);
+
+    /// Pool with one worker per hardware thread, created on first use
+    static Thread_Pool& shared();
+    /// Whether shared() pins its workers; must be called before its first use
+    static void pin_shared(bool pin);
+
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
         -> std::future<typename std::invoke_result<F, Args...>::type> {
 
         using return_type = typename std::invoke_result<F, Args...>::type;
-        assert(!stop_now && !stop_when_done);
 
         auto task = std::make_shared<std::packaged_task<return_type()>>(
             std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
         std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            tasks.emplace([task]() { (*task)(); });
-        }
-        condition.notify_one();
+        push([task](bool run) {
+            if(run) (*task)();
+        });
         return res;
     }
 
+    /// Run f on the pool at the given priority, with nothing to wait on it
+    template<class F> void detach(F&& f, Priority priority = Priority::normal) {
+        push([f = std::forward<F>(f)](bool run) mutable {
+            if(run) f();
+        }, priority);
+    }
+
+    /// Block until done() holds; whatever makes it hold must then call
+    /// notify_helpers(). A worker runs tasks at least as urgent as priority in
+    /// the meantime, so waits on tasks of the same pool can nest.
+    template<typename Done> void wait_until(Priority priority, Done&& done) {
+        bool worker = current_worker() >= 0;
+        while(!done()) {
+            if(worker && run_one(priority)) continue;
+            std::unique_lock<std::mutex> lock(sleep_mut);
+            helpers++;
+            helping.wait(lock, [&] { return done() || (worker && runnable(priority)); });
+            helpers--;
+        }
+    }
+    void notify_helpers();
+
 private:
-    void start(size_t);
+    // Tasks are told whether to run or are being skipped by clear()
+    using Task_Fn = std::function<void(bool)>;
+    struct Task {
+        Task_Fn fn;
+        size_t generation = 0;
+    };
+    struct Worker {
+        std::mutex mut;
+        std::deque<Task> tasks[(int)Priority::count];
+
+        // Fixed before the workers start
+        int cpu = -1;
+        std::vector<size_t> victims; // same NUMA node first
+    };
+
+    void push(Task_Fn&& fn, Priority priority = Priority::normal);
+    bool pop(size_t self, Priority priority, Task& task);
+    bool run_one(Priority lowest = Priority::background);
+    bool runnable(Priority lowest) const;
+    void run(size_t self);
+    void place_workers(bool pin);
+    int current_worker() const;
+
     size_t n_threads;
-    bool stop_now = true;
-    bool stop_when_done = true;
-    std::mutex queue_mutex;
-    std::condition_variable condition;
+    std::atomic<bool> stopping;
+    std::atomic<size_t> generation, queued, unfinished;
+    std::atomic<size_t> waiting[(int)Priority::count];
+
+    std::mutex injected_mut;
+    std::deque<Task> injected[(int)Priority::count];
+    std::vector<std::unique_ptr<Worker>> queues;
+
+    // Idle workers sleep on wake, wait_until() on helping; wait() sleeps on idle
+    std::mutex sleep_mut;
+    std::condition_variable wake, idle, helping;
+    size_t helpers = 0;
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+
+    friend class Task_Group;
+    friend class Task_Graph;
 };
+
+// Shared flag that tasks can poll to stop early
+class Cancel_Token {
+public:
+    Cancel_Token() : flag(std::make_shared<std::atomic<bool>>(false)) {
+    }
+    bool cancelled() const {
+        return flag->load();
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+    friend class Task_Group;
+};
+
+// A set of tasks on a pool that can be waited on or cancelled without
+// affecting anything else on the pool. Waiting from a worker thread runs
+// other tasks in the meantime, so groups may be nested.
+class Task_Group {
+public:
+    Task_Group(Thread_Pool& pool, Priority priority = Priority::normal);
+    ~Task_Group();
+
+    Task_Group(const Task_Group&) = delete;
+    Task_Group& operator=(const Task_Group&) = delete;
+
+    template<class F> void run(F&& f) {
+        state->pending++;
+        pool.push([&pool = pool, state = state, token = current,
+                   f = std::forward<F>(f)](bool run) mutable {
+            if(run && !token.cancelled()) f();
+            bool last;
+            {
+                std::lock_guard<std::mutex> lock(state->mut);
+                last = --state->pending == 0;
+                if(last) state->done.notify_all();
+            }
+            if(last) pool.notify_helpers();
+        }, priority);
+    }
+
+    void wait();
+    /// Skip the tasks added so far that have not started; later tasks run as usual
+    void cancel();
+    /// Token for the tasks added so far; running tasks may poll it to stop early
+    Cancel_Token token() const;
+
+private:
+    struct State {
+        std::atomic<size_t> pending{0};
+        std::mutex mut;
+        std::condition_variable done;
+    };
+
+    Thread_Pool& pool;
+    Priority priority;
+    std::shared_ptr<State> state;
+    Cancel_Token current;
+};
+
+// Tasks that each start once every task they depend on has finished. Nodes
+// can only depend on nodes added before them, so the graph is always acyclic.
+class Task_Graph {
+public:
+    using Node = size_t;
+
+    Task_Graph(Thread_Pool& pool, Priority priority = Priority::normal);
+    ~Task_Graph();
+
+    Task_Graph(const Task_Graph&) = delete;
+    Task_Graph& operator=(const Task_Graph&) = delete;
+
+    /// Must be called before run()
+    Node add(std::function<void()> f, const std::vector<Node>& deps = {});
+
+    /// Start the nodes without dependencies; the rest start as theirs finish
+    void run();
+    /// Run every node on the calling thread, in the order they were added
+    void run_inline();
+
+    void wait();
+    /// Block until node has finished
+    void wait(Node node);
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        std::vector<Node> dependents;
+        std::atomic<size_t> remaining{0};
+        bool done = false;
+    };
+
+    void start(Node node);
+    void finish(Node node);
+
+    Thread_Pool& pool;
+    Priority priority;
+    Task_Group group;
+    std::vector<std::unique_ptr<Task>> tasks;
+
+    std::mutex mut;
+    std::condition_variable cond;
+};
+
+// Calls f(begin, end) on consecutive blocks of [begin, end) holding at least
+// grain indices each, spread over the pool. The calling thread works on blocks
+// too, and waiting from a worker runs other tasks, so calls may be nested
+// inside tasks on the same pool. Helpers are queued at the given priority, but
+// only blocks they have started are waited on: if the pool is busy, the caller
+// ends up running every block itself rather than waiting for a free worker.
+template<typename F>
+void parallel_for(Thread_Pool& pool, size_t begin, size_t end, size_t grain, F&& f,
+                  Priority priority = Priority::normal) {
+
+    if(end <= begin) return;
+    grain = std::max(grain, size_t(1));
+
+    size_t n = end - begin;
+    size_t blocks = std::min((n + grain - 1) / grain, pool.size() * 4);
+    if(blocks <= 1 || pool.size() == 1) {
+        f(begin, end);
+        return;
+    }
+
+    // Helpers may start after the caller has returned, so they share only this
+    // state, and touch f only once they have claimed a block
+    struct Blocks {
+        std::atomic<size_t> next{0}, left{0};
+    };
+    auto state = std::make_shared<Blocks>();
+    state->left = blocks;
+
+    size_t block = (n + blocks - 1) / blocks;
+    auto work = [&pool, state, blocks, block, begin, end, f = &f]() {
+        for(size_t i = state->next++; i < blocks; i = state->next++) {
+            size_t b = begin + i * block;
+            if(b < end) (*f)(b, std::min(b + block, end));
+            if(state->left.fetch_sub(1) == 1) pool.notify_helpers();
+        }
+    };
+
+    for(size_t i = 1; i < std::min(blocks, pool.size() + 1); i++) pool.detach(work, priority);
+    work();
+    pool.wait_until(priority, [&state] { return state->left.load() == 0; });
+}
+
+template<typename F> void parallel_for(size_t begin, size_t end, size_t grain, F&& f) {
+    parallel_for(Thread_Pool::shared(), begin, end, grain, std::forward<F>(f));
+}
+
+// Reduces map(begin, end) over blocks of [begin, end) as in parallel_for. Block
+// results are combined in order, so the result does not depend on scheduling.
+template<typename T, typename Map, typename Reduce>
+T parallel_reduce(Thread_Pool& pool, size_t begin, size_t end, size_t grain, T identity,
+                  Map&& map, Reduce&& reduce) {
+
+    if(end <= begin) return identity;
+    grain = std::max(grain, size_t(1));
+
+    size_t n = end - begin;
+    size_t blocks = std::min((n + grain - 1) / grain, pool.size() * 4);
+    if(blocks <= 1 || pool.size() == 1) return reduce(identity, map(begin, end));
+
+    size_t block = (n + blocks - 1) / blocks;
+    std::vector<T> partial(blocks, identity);
+    parallel_for(pool, 0, blocks, 1, [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; i++) {
+            size_t lo = begin + i * block;
+            if(lo < end) partial[i] = map(lo, std::min(lo + block, end));
+        }
+    });
+
+    T ret = identity;
+    for(const T& p : partial) ret = reduce(ret, p);
+    return ret;
+}
+
+template<typename T, typename Map, typename Reduce>
+T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, Map&& map,
+                  Reduce&& reduce) {
+    return parallel_reduce(Thread_Pool::shared(), begin, end, grain, identity,
+                           std::forward<Map>(map), std::forward<Reduce>(reduce));
+}